@@ -1,16 +1,63 @@
 #ifndef AMGRAPH_H
 #define AMGRAPH_H
 
-#include <ostream> // std::ostream
+#include <iostream> // std::ostream, std::cout
 #include <cassert> 
+#include <cstring> // std::memcpy, std::memset
 #include <iterator> // std::forward_iterator_tag
 #include <cstddef>  // std::ptrdiff_t
 #include <stdexcept>
+#include <vector>
+#include <algorithm> // std::stable_sort
+#include <cstdint>
+#include <cmath>    // std::sqrt
+#include <limits>   // std::numeric_limits
+#include <thread>
+#include <exception> // std::exception_ptr
+#include <type_traits>
+#include <functional> // std::hash
+#include <utility>    // std::pair, std::declval
+#include "amgraph_metrics.h"
+#include "amgraph_handle.h"
+
+// Strumentazione: senza AMGRAPH_METRICS le macro spariscono
+#ifdef AMGRAPH_METRICS
+#define AMGRAPH_TIMED(op) metrics_timer amgraph_timer_(_metrics.op)
+#define AMGRAPH_METRIC(stmt) stmt
+#else
+#define AMGRAPH_TIMED(op)
+#define AMGRAPH_METRIC(stmt)
+#endif
 /**
   @file Amgraph.h
   @brief Dichiarazione della classe Amgraph
 */
 
+/**
+  @brief Policy dell'indice diretto dei nodi
+
+  Se value è true, Amgraph<T> non cerca i nodi scorrendo _vertices ma
+  usa una tabella valore -> indice con offset, che cresce da sola,
+  finché gli identificativi restano densi (altrimenti torna alla
+  ricerca lineare). Vale per i tipi interi; si può specializzare a
+  false per disattivarla.
+*/
+template <typename T>
+struct amgraph_direct_index
+  : std::integral_constant<bool, std::is_integral<T>::value &&
+                                 !std::is_same<T, bool>::value> { };
+
+/**
+  @brief true se std::hash<T> è utilizzabile
+*/
+template <typename T, typename = void>
+struct amgraph_is_hashable : std::false_type { };
+
+template <typename T>
+struct amgraph_is_hashable<T,
+  std::void_t<decltype(std::hash<T>()(std::declval<const T &>()))> >
+  : std::true_type { };
+
 /**
   @brief Classe Amgraph
 
@@ -28,14 +75,35 @@
     - Arc invece rappresenta il collegamento tra due oggetti Nodi
     - Vertex è usato nelle funzioni private
 
+  Modalità (parametro template Directed):
+    - Directed = true (default): grafo orientato, matrice completa
+      _size x _size di bool, add_Arc(a, b) setta solo [a][b]
+    - Directed = false: grafo non orientato, si memorizza solo il
+      triangolo superiore (diagonale inclusa) come array di bit
+      impacchettati. Memoria dimezzata e connected con un solo accesso.
+
 */
-template <typename T>
+template <typename T, bool Directed = true>
 class Amgraph {
 
 public:
   
   typedef T value_type;
   typedef unsigned int size_type; 
+
+  // new value_type[n] e le copie dei nodi richiedono un T CopyAssignable
+  static_assert(std::is_same<decltype(std::declval<T &>() = std::declval<const T &>()),
+                             T &>::value,
+                "Amgraph: T::operator= deve restituire T&");
+
+  /**
+    @brief Modalità del grafo
+
+    @return true se il grafo è orientato
+  */
+  static constexpr bool is_directed() {
+    return Directed;
+  }
  
   /**
     @brief Costruttore di default
@@ -47,7 +115,9 @@ public:
     @post _size = 0
     @post _adjacencyMatrix = nullptr
   */
-  Amgraph() : _vertices(nullptr), _size(0), _adjacencyMatrix(nullptr) { 
+  Amgraph() : _vertices(nullptr), _size(0), _adjacencyMatrix(nullptr),
+  _halfMatrix(nullptr), _journaling(false), _offset(), _directMapped(true),
+  _generation(amgraph_next_generation()) { 
     // Initialization list
  
   
@@ -66,10 +136,12 @@ public:
 
   ~Amgraph()  {
   delete[] _vertices;
-  for (int i = 0; i < _size; ++i) {
+  if (_adjacencyMatrix != nullptr)
+    for (size_type i = 0; i < _size; ++i) {
             delete[] _adjacencyMatrix[i];
         }
   delete[] _adjacencyMatrix;
+  delete[] _halfMatrix;
   // _adjacencyMatrix = nullptr;
   // _vertices = nullptr;
   // _size = 0;
@@ -92,44 +164,23 @@ public:
     @post _adjacencyMatrix != nullptr
   */
   Amgraph(const Amgraph &other) : _vertices(nullptr), _size(0), 
-  _adjacencyMatrix(nullptr) {
-
-  
-  _vertices = new value_type[other._size];
-  _size = other._size;
-  
-  try {
-    for(size_type i=0; i<_size; ++i)
-      _vertices[i] = other._vertices[i];
+  _adjacencyMatrix(nullptr), _halfMatrix(nullptr), _journaling(false),
+  _direct(other._direct), _offset(other._offset),
+  _directMapped(other._directMapped), _generation(other._generation) {
+
+  // se una copia o un'allocazione lancia, ~scratch libera tutto
+  scratch copy(other._size);
+  for (size_type i = 0; i < other._size; ++i)
+    copy.vertices[i] = other._vertices[i];
+  if constexpr (Directed) {
+    for (size_type i = 0; i < other._size; ++i)
+      std::memcpy(copy.rows[i], other._adjacencyMatrix[i], other._size);
   }
-  catch(...) {
-    delete[] _vertices;
-    _vertices = nullptr;
-    _size =0;
-    throw;
+  else if (other._size > 0) {
+    std::memcpy(copy.half, other._halfMatrix, halfBytes(other._size));
   }
+  commit(copy);
 
-  _adjacencyMatrix = new bool*[_size];
-
-  try{
-    for (int i = 0; i < _size; ++i) {
-              _adjacencyMatrix[i] = new bool[_size];
-              for (int j = 0; j < _size; ++j) {
-                  _adjacencyMatrix[i][j] = other._adjacencyMatrix[i][j];
-              }
-          }
-  }
-  catch (...) {
-        // Allocation failed
-        if (_adjacencyMatrix != nullptr) {
-            for (int i = 0; i < _size; ++i) {
-                delete[] _adjacencyMatrix[i];
-            }
-            // Deallocate the array of row pointers
-            delete[] _adjacencyMatrix;
-        }
-        throw;
-    }
   #ifndef NDEBUG
   std::cout << "Amgraph::Amgraph(const Amgraph&)"<< std::endl;
   #endif
@@ -156,6 +207,9 @@ public:
     Amgraph tmp(other);
 
     this->swap(tmp);
+    // il journal resta quello di questo oggetto
+    std::swap(_journal, tmp._journal);
+    std::swap(_journaling, tmp._journaling);
   }
 
   #ifndef NDEBUG
@@ -196,6 +250,13 @@ public:
     std::swap(_vertices, other._vertices);
     std::swap(_size, other._size); 
     std::swap(_adjacencyMatrix, other._adjacencyMatrix);
+    std::swap(_halfMatrix, other._halfMatrix);
+    _journal.swap(other._journal);
+    std::swap(_journaling, other._journaling);
+    _direct.swap(other._direct);
+    std::swap(_offset, other._offset);
+    std::swap(_directMapped, other._directMapped);
+    std::swap(_generation, other._generation);
   }
 
   /*
@@ -352,6 +413,121 @@ public:
   const_iterator end() const {
     return const_iterator(_vertices + _size);
   }
+
+  /**
+    @brief Handle tipizzato di un vertice
+
+    Incapsula l'indice del nodo nell'array _vertices: si risolve il
+    value_type una volta sola (add_Node o find) e poi si lavora sugli
+    indici senza confronti tra value_type.
+
+    Un handle resta valido dopo add_Node, add_Arc e remove_Arc.
+    remove_Node, permute, reorder e apply_delta cambiano la generazione
+    del grafo: i metodi che ricevono un handle precedente lanciano
+    std::invalid_argument.
+
+    @see amgraph_vertex_handle
+  */
+  typedef amgraph_vertex_handle vertex_handle;
+
+  /**
+    @brief Iteratore sui vicini di un vertice
+
+    Scorre la riga del vertice saltando le celle vuote.
+    Nel grafo orientato restituisce gli archi uscenti,
+    in quello non orientato tutti i nodi adiacenti.
+  */
+  class neighbor_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef vertex_handle             value_type;
+    typedef ptrdiff_t                 difference_type;
+    typedef const vertex_handle*      pointer;
+    typedef vertex_handle             reference;
+
+    neighbor_iterator() : _graph(nullptr), _row(0), _col(0) { }
+
+    reference operator*() const {
+      return vertex_handle(_col, _graph->_generation);
+    }
+
+    neighbor_iterator operator++(int) {
+      neighbor_iterator old(*this);
+      ++(*this);
+      return old;
+    }
+
+    neighbor_iterator &operator++() {
+      ++_col;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const neighbor_iterator &other) const {
+      return _col == other._col;
+    }
+
+    bool operator!=(const neighbor_iterator &other) const {
+      return _col != other._col;
+    }
+
+  private:
+    const Amgraph *_graph;
+    size_type _row;
+    size_type _col;
+
+    friend class Amgraph;
+
+    neighbor_iterator(const Amgraph *graph, size_type row, size_type col)
+      : _graph(graph), _row(row), _col(col) {
+      skip();
+    }
+
+    // avanza fino al prossimo arco o alla fine della riga
+    void skip() {
+      while (_col < _graph->_size && !_graph->hasEdge(_row, _col))
+        ++_col;
+    }
+  }; // fine della classe neighbor_iterator
+
+  /**
+    @brief Range dei vicini, utilizzabile nei range-for
+  */
+  typedef amgraph_range<neighbor_iterator> neighbor_range;
+
+  /**
+    @brief find: risolve un nodo nel suo handle
+
+    @param node riferimento costante a value_type
+
+    @return handle del nodo, non valido se il nodo non esiste
+  */
+  vertex_handle find(const value_type &node) const {
+    int index = this->getVertexIndex(node);
+    if (index == -1)
+      return vertex_handle();
+    return vertex_handle(index, _generation);
+  }
+
+  /**
+    @brief Nodo riferito da un handle
+
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  const value_type &value(vertex_handle h) const {
+    requireHandle(h);
+    return _vertices[h.index()];
+  }
+
+  /**
+    @brief Handle del nodo in posizione index
+
+    @pre index < getSize()
+  */
+  vertex_handle handle(size_type index) const {
+    assert(index < _size);
+    return vertex_handle(index, _generation);
+  }
   /**
     @brief Funzione per aggiungere un Nodo
 
@@ -361,73 +537,50 @@ public:
     
     @param una regreference a un nome di un nodo di tipo value_type
     
+    @return handle del nodo (quello esistente se era già presente)
+
     @post _vertices != nullptr
     @post _size = _size + 1
     @post _adjacencyMatrix != nullptr
 
   */
-  void add_Node(const value_type &node){
+  vertex_handle add_Node(const value_type &node){
+    AMGRAPH_TIMED(add_node);
     // check if node is present
     // use get vertex index
-      if ( this->getVertexIndex(node) != -1){
+      int present = this->getVertexIndex(node);
+      if ( present != -1){
         //std::cout<< "node " << node <<" already present" << std::endl;
         std::cout<< "node already present" << std::endl;
-        return;
+        return vertex_handle(present, _generation);
         }
 
-    value_type* new_vertices = new value_type[_size + 1];
-    try{
-      // copy vertices
-      for (int i = 0; i < _size ; ++i) {
-        new_vertices[i] = _vertices[i];
-      }
-      new_vertices[_size] = node;
-    }
-    catch(...){
-      delete[] new_vertices;
-      throw;
-    }
-        // handle matrix
-    bool** new_adjacencyMatrix = new bool*[_size + 1];
-    
-    try{
-      for (int i = 0; i < _size + 1 ; ++i) {
-        new_adjacencyMatrix[i] = new bool[_size + 1];
-        }
-      // copy old block
-      for (int i = 0; i < _size; ++i) {
-        for (int j = 0; j < _size; ++j)
-            new_adjacencyMatrix[i][j] = _adjacencyMatrix[i][j];
-        }
-      // fill last row and last column with "false"
-      for (int i = 0; i < _size + 1; ++i) {
-        new_adjacencyMatrix[_size][i] = false;
-        new_adjacencyMatrix[i][_size] = false;
-        }
-    }
-    catch(...){
-        if (new_adjacencyMatrix != nullptr) {
-            for (int i = 0; i < (_size + 1); ++i) {
-                delete[] new_adjacencyMatrix[i];
-            }
-            delete[] new_adjacencyMatrix;
-        }
-        delete[] new_vertices;
-        throw;
-    }
+    // prima di toccare il grafo: se la tabella non basta si allarga qui
+    reserveIndex(node);
 
-    // clean temp data
-    std::swap(_vertices, new_vertices);
+    AMGRAPH_METRIC(++_metrics.reallocations;)
+    scratch next(_size + 1);
+    for (size_type i = 0; i < _size; ++i)
+      next.vertices[i] = _vertices[i];
+    next.vertices[_size] = node;
 
-    delete[] new_vertices;
-    
-    std::swap(_adjacencyMatrix, new_adjacencyMatrix);
-    for (int i = 0; i < _size; ++i) {
-        delete[] new_adjacencyMatrix[i];
-     }
-    delete[] new_adjacencyMatrix;
+    if constexpr (!Directed) {
+      // il triangolo è memorizzato per colonne: la colonna del nuovo
+      // nodo si accoda ai bit esistenti, che restano dove sono
+      if (_size > 0)
+        std::memcpy(next.half, _halfMatrix, halfBytes(_size));
+    }
+    else {
+      // ultima riga e ultima colonna restano a false
+      for (size_type i = 0; i < _size; ++i)
+        std::memcpy(next.rows[i], _adjacencyMatrix[i], _size);
+    }
 
-    _size += 1;
+    // ultimo passo che può lanciare: dopo si scambiano solo puntatori
+    logNode(node);
+    commit(next);
+    setIndex(node, _size - 1);
+    return vertex_handle(_size - 1, _generation);
     }
 /**
     @brief Funzione per rimuovere un Nodo
@@ -447,86 +600,46 @@ public:
 
 */
   void remove_Node(const value_type &node){
+    AMGRAPH_TIMED(remove_node);
     // check if node is present
     // use get vertex index
-    int index = this->getVertexIndex(node);
-      if ( index == -1){
+    int found = this->getVertexIndex(node);
+      if ( found == -1){
         std::cout<< "node " << node <<" not present" << std::endl;
         return;
         }
-
-    // try catch
-
-    value_type* new_vertices = new value_type[_size - 1];
-    try{
-      // copy vertices
-      for (int i = 0; i < index ; ++i) {
-        new_vertices[i] = _vertices[i];
-        }
-      for (int i = index; i < _size - 1 ; ++i) {
-        new_vertices[i] = _vertices[i + 1];
+    const size_type index = static_cast<size_type>(found);
+
+    AMGRAPH_METRIC(++_metrics.reallocations;)
+    scratch next(_size - 1);
+    for (size_type i = 0; i < _size - 1; ++i)
+      next.vertices[i] = _vertices[i < index ? i : i + 1];
+
+    if constexpr (!Directed) {
+      // si salta riga e colonna di index
+      for (size_type j = 0; j < _size - 1; ++j) {
+        size_type old_j = (j < index) ? j : j + 1;
+        for (size_type i = 0; i <= j; ++i) {
+          size_type old_i = (i < index) ? i : i + 1;
+          if (testBit(_halfMatrix, halfBit(old_i, old_j)))
+            setBit(next.half, halfBit(i, j));
         }
+      }
     }
-    catch(...){
-      delete[] new_vertices;
-      throw;      
+    else {
+      // ogni riga tranne index, senza la colonna index
+      for (size_type i = 0; i < _size - 1; ++i) {
+        const bool *src = _adjacencyMatrix[i < index ? i : i + 1];
+        std::memcpy(next.rows[i], src, index);
+        std::memcpy(next.rows[i] + index, src + index + 1, _size - 1 - index);
+      }
     }
 
-        // handle matrix
-    bool** new_adjacencyMatrix = new bool*[_size - 1];
-
-    try{
-      
-      for (int i = 0; i < _size - 1 ; ++i) {
-        new_adjacencyMatrix[i] = new bool[_size - 1];
-        }
-
-      // copy first block
-      for (int i = 0; i < index; ++i) {
-        for (int j = 0; j < index; ++j)
-            new_adjacencyMatrix[i][j] = _adjacencyMatrix[i][j];
-        }
-
-      // copy fourth block
-      for (int i = index; i < _size - 1; ++i) {
-        for (int j = index; j < _size - 1; ++j)
-            new_adjacencyMatrix[i][j] = _adjacencyMatrix[i + 1][j + 1];
-        }
-
-      // copy second block
-      for (int i = 0; i < index; ++i) {
-        for (int j = index; j < _size - 1; ++j)
-            new_adjacencyMatrix[i][j] = _adjacencyMatrix[i][j + 1];
-        }
-
-      // copy third block
-      for (int i = index; i < _size - 1; ++i) {
-        for (int j = 0; j < index; ++j)
-            new_adjacencyMatrix[i][j] = _adjacencyMatrix[i + 1][j];
-        }
-    }
-    catch(...){
-      // Allocation failed
-        if (_adjacencyMatrix != nullptr) {
-            for (int i = 0; i < _size - 1; ++i) {
-                delete[] new_adjacencyMatrix[i];
-            }
-            // Deallocate the array of row pointers
-            delete[] new_adjacencyMatrix;
-            }
-        throw;
-        }
-    // clean temp data
-    std::swap(_vertices, new_vertices);
-    delete[] new_vertices;
-    std::swap(_adjacencyMatrix, new_adjacencyMatrix);
-    for (int i = 0; i < _size; ++i) {
-          delete[] new_adjacencyMatrix[i];
-      }
-    delete[] new_adjacencyMatrix;
-    
-    // size--
-    _size -= 1;
+    logRecord(delta::remove_node, index);
+    commit(next);
+    eraseIndex(node, index);
+    // gli indici dopo index sono scalati: gli handle vecchi non valgono più
+    _generation = amgraph_next_generation();
     }
 
   /**
@@ -545,6 +658,7 @@ public:
 
   */
   void add_Arc(const value_type &node1, const value_type &node2){
+    AMGRAPH_TIMED(add_arc);
     int index1 = this->getVertexIndex(node1);
     int index2 = this->getVertexIndex(node2);
     if (index1 == -1 || index2 == -1){
@@ -554,6 +668,7 @@ public:
       std::cout << "Already Linked";
       return;
     }
+    logRecord(delta::add_arc, index1, index2);
     this->addEdge(index1, index2);
   }
 
@@ -589,9 +704,68 @@ public:
       std::cout << "WARNING: No Link existing, nothing removed" << std::endl;
       return;
     }
+    logRecord(delta::remove_arc, index1, index2);
     this->removeEdge(index1, index2);
   }
 
+  /**
+    @brief add_Arc su handle
+
+    Come add_Arc(node1, node2) ma senza ricerca dei nodi.
+
+    @throw std::invalid_argument se h1 o h2 non sono validi per questo grafo
+  */
+  void add_Arc(vertex_handle h1, vertex_handle h2){
+    AMGRAPH_TIMED(add_arc);
+    requireHandle(h1);
+    requireHandle(h2);
+    logRecord(delta::add_arc, h1.index(), h2.index());
+    this->addEdge(h1.index(), h2.index());
+  }
+
+  /**
+    @brief remove_Arc su handle
+
+    @throw std::invalid_argument se h1 o h2 non sono validi per questo grafo
+  */
+  void remove_Arc(vertex_handle h1, vertex_handle h2){
+    requireHandle(h1);
+    requireHandle(h2);
+    logRecord(delta::remove_arc, h1.index(), h2.index());
+    this->removeEdge(h1.index(), h2.index());
+  }
+
+  /**
+    @brief connected su handle
+
+    Stessa semantica di connected(node1, node2): nel grafo orientato
+    conta l'arco in entrambe le direzioni.
+
+    @throw std::invalid_argument se h1 o h2 non sono validi per questo grafo
+  */
+  bool connected(vertex_handle h1, vertex_handle h2) const{
+    AMGRAPH_TIMED(connected);
+    requireHandle(h1);
+    requireHandle(h2);
+    if constexpr (!Directed)
+      return this->hasEdge(h1.index(), h2.index());
+    return this->hasEdge(h1.index(), h2.index()) ||
+           this->hasEdge(h2.index(), h1.index());
+  }
+
+  /**
+    @brief Vicini di un nodo
+
+    @see neighbor_iterator
+
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  neighbor_range neighbors(vertex_handle h) const{
+    requireHandle(h);
+    return neighbor_range(neighbor_iterator(this, h.index(), 0),
+                          neighbor_iterator(this, h.index(), _size));
+  }
+
   template<typename Iter>
     void add_Nodes(Iter start, Iter end) {
         while (start != end) {
@@ -600,115 +774,1957 @@ public:
         }
     }
 
-  private:
   /**
-   @brief Aggiunge un arco tra due indici
+    @brief Batch di modifiche (delta) di un Amgraph
+
+    Contiene i record binari delle mutazioni, nell'ordine in cui sono
+    avvenute, e i valori dei nodi aggiunti. records() inizia con
+    un'intestazione sullo stato di partenza: numero di nodi (varint) e
+    impronta di nodi e archi (8 byte little endian); apply_delta la
+    confronta con il grafo di destinazione. Segue un record per
+    mutazione, un byte di opcode seguito dagli indici dei nodi
+    codificati come varint:
+      - add_node: nessun indice, il valore è il prossimo di nodes()
+      - remove_node: indice del nodo
+      - add_arc, remove_arc: indici di sorgente e destinazione
+      - permute: numero di nodi n seguito dalla permutazione
+        (perm[nuovo] = vecchio) come da permute()
+
+    Gli indici sono quelli del grafo al momento della mutazione, per
+    cui un delta si applica solo a una replica nello stesso stato
+    iniziale: una replica divergente viene rifiutata grazie
+    all'intestazione.
+    La serializzazione di nodes() per il trasporto è a carico del
+    chiamante, records() è già in forma binaria.
+  */
+  class delta {
+  public:
+    enum opcode { add_node = 0, remove_node = 1, add_arc = 2, remove_arc = 3,
+                  permute = 4 };
 
-    @param src indice source
-    @param desr indice destinazione
+    delta() { }
 
-    @post _adjacenceMatrix[src][dest] == true;
+    /**
+      @brief Ricostruisce un delta ricevuto
+
+      @param records record binari (come da records())
+      @param nodes valori dei nodi aggiunti (come da nodes())
     */
+    delta(const std::vector<unsigned char> &records,
+          const std::vector<value_type> &nodes)
+      : _records(records), _nodes(nodes) { }
 
-  void addEdge(int src, int dest) {
-      _adjacencyMatrix[src][dest] = true;
-  }
+    const std::vector<unsigned char> &records() const {
+      return _records;
+    }
 
-  /**
-   @brief Rimuove un arco tra due indici
+    const std::vector<value_type> &nodes() const {
+      return _nodes;
+    }
 
-    @param src indice source
-    @param desr indice destinazione
+    bool empty() const {
+      return _records.empty();
+    }
 
-    @post _adjacenceMatrix[src][dest] == false;
-    */
-  void removeEdge(int src, int dest) {
-      _adjacencyMatrix[src][dest] = false;
-  }
-  
-  /**
-   @brief const function: check arco tra due indici
+    void clear() {
+      _records.clear();
+      _nodes.clear();
+    }
 
-    @param src indice source
-    @param desr indice destinazione
+    void swap(delta &other) {
+      _records.swap(other._records);
+      _nodes.swap(other._nodes);
+    }
+
+  private:
+    std::vector<unsigned char> _records;
+    std::vector<value_type> _nodes;
+
+    friend class Amgraph;
+  }; // fine della classe delta
 
-    */
-  bool hasEdge(int src, int dest) const{
-      return _adjacencyMatrix[src][dest];
-  }
   /**
-   @brief getVertexName
+    @brief Attiva il journal delle mutazioni
 
-    ritorna nodo di tipo T indice dall'array dei nodi.
-    @param index indice
-    
-    */
-  T getVertexName(int index) const{
-      return _vertices[index];
+    Da questo momento add_Node, remove_Node, add_Arc, remove_Arc e
+    apply_delta vengono registrati. Le copie partono senza journal.
+  */
+  void enable_journal() {
+    _journaling = true;
   }
-  /**
-   @brief getVertexIndex: Cerca Nodo 
-    
-    Dato un identificativo di un nodo restutisce l'indice al quale quel nodo appare nel vettore _vertices
 
-    @param node riferimento costante a value_type
+  /**
+    @brief Disattiva il journal (il contenuto viene mantenuto)
+  */
+  void disable_journal() {
+    _journaling = false;
+  }
 
-    @returns -1 se non trovato
+  bool journaling() const {
+    return _journaling;
+  }
 
-    */
-  int getVertexIndex(const value_type &node) const{
-    for(int i = 0; i < _size; ++i)
-      if (node == _vertices[i])
-        return i;
-    return -1;
+  /**
+    @brief Mutazioni registrate dall'ultimo take_journal
+  */
+  const delta &journal() const {
+    return _journal;
   }
 
-  public:
-    /**
-    @brief exists 
-    
-    Dato un identificativo di un nodo restituisce se è presente nell'array.
+  /**
+    @brief Estrae il journal e lo svuota
 
-    @see getVertexIndex
-    
-    @param node riferimento costante a value_type
+    @return il delta accumulato, pronto da spedire alle repliche
+  */
+  delta take_journal() {
+    delta out;
+    out.swap(_journal);
+    return out;
+  }
 
-    @returns false se non trovato
+  /**
+    @brief Applica un delta in un solo passaggio
+
+    Il delta viene prima decodificato per calcolare l'insieme finale dei
+    nodi, poi si alloca una sola volta la nuova struttura copiando i
+    nodi sopravvissuti, e infine si scrivono gli archi ordinati per riga.
+    La decodifica costa O(log n) per record (le rimozioni spengono uno
+    slot invece di spostare gli indici) più una passata per permute;
+    i nodi aggiunti si confrontano con una tabella hash se std::hash<T>
+    esiste.
+    Gli archi che toccano nodi rimossi nello stesso delta vengono
+    scartati. A parità di cella vale l'ultima operazione.
+
+    Se la decodifica fallisce il grafo non viene modificato.
+
+    @param d delta da applicare
+
+    @throw std::invalid_argument se il delta è malformato o non
+      compatibile con lo stato del grafo (parte da un altro stato,
+      aggiunge un nodo già presente o contiene nodi non usati da
+      nessun record)
   */
+  void apply_delta(const delta &d) {
+    const size_type npos = static_cast<size_type>(-1);
+    const std::size_t added = d._nodes.size();
+    const std::size_t total = static_cast<std::size_t>(_size) + added;
+
+    const unsigned char *p = d._records.data();
+    const unsigned char *end = p + d._records.size();
+    if (p == end) {
+      if (added != 0)
+        throw std::invalid_argument("apply_delta: nodi in eccesso nel delta");
+      return;
+    }
+    // intestazione: il delta deve partire dallo stato di questo grafo
+    size_type base_size = readVarint(p, end);
+    if (end - p < 8)
+      throw std::invalid_argument("apply_delta: record troncato");
+    std::uint64_t base = 0;
+    for (int k = 0; k < 8; ++k)
+      base |= static_cast<std::uint64_t>(*p++) << (8 * k);
+    if (base_size != _size || base != fingerprint())
+      throw std::invalid_argument("apply_delta: il delta non parte dallo stato di questo grafo");
+    const std::size_t header = static_cast<std::size_t>(p - d._records.data());
+
+    // present[k]: indice attuale del valore d.nodes()[k], -1 se assente;
+    // previous[k]: posizione in d.nodes() dell'aggiunta precedente
+    // dello stesso valore, -1 se non c'è
+    std::vector<int> present(added);
+    resolveBatch(added, [&d](std::size_t k) -> const value_type & {
+      return d._nodes[k];
+    }, present.data());
+    std::vector<int> previous(added);
+    previousEqual(d._nodes, previous);
+
+    // slots[s]: origine nello slot s, un vecchio indice (< _size)
+    // oppure _size + posizione in d.nodes(); le aggiunte occupano slot
+    // nuovi in coda e le rimozioni spengono lo slot nell'albero, che
+    // trova l'i-esimo slot vivo in O(log n)
+    std::vector<size_type> slots(total);
+    for (size_type i = 0; i < _size; ++i)
+      slots[i] = i;
+    std::size_t used = _size;
+    rank_tree alive(total, _size);
+    // live[o]: l'origine o è un nodo del grafo nel punto corrente del delta
+    std::vector<bool> live(total, true);
+
+    struct arc_op {
+      size_type src;
+      size_type dest;
+      bool add;
+    };
+    std::vector<arc_op> arcs;
+
+    size_type next_node = 0;
+    while (p != end) {
+      unsigned char op = *p++;
+      switch (op) {
+        case delta::add_node: {
+          if (next_node >= added)
+            throw std::invalid_argument("apply_delta: nodo mancante nel delta");
+          // come add_Node: il valore non deve essere già nel grafo; fra
+          // le aggiunte precedenti dello stesso valore solo l'ultima
+          // può essere ancora viva
+          if ((present[next_node] != -1 && live[present[next_node]]) ||
+              (previous[next_node] != -1 && live[_size + previous[next_node]]))
+            throw std::invalid_argument("apply_delta: nodo già esistente");
+          slots[used] = _size + next_node++;
+          alive.add(used++, 1);
+          break;
+        }
+        case delta::remove_node: {
+          size_type index = readVarint(p, end);
+          if (index >= alive.count())
+            throw std::invalid_argument("apply_delta: indice non valido");
+          std::size_t slot = alive.find(index);
+          live[slots[slot]] = false;
+          alive.add(slot, -1);
+          break;
+        }
+        case delta::permute: {
+          size_type n = readVarint(p, end);
+          if (n != alive.count())
+            throw std::invalid_argument("apply_delta: permutazione non valida");
+          std::vector<size_type> current;
+          current.reserve(n);
+          for (std::size_t slot = 0; slot < used; ++slot)
+            if (live[slots[slot]])
+              current.push_back(slots[slot]);
+          std::vector<bool> seen(n, false);
+          for (size_type i = 0; i < n; ++i) {
+            size_type from = readVarint(p, end);
+            if (from >= n || seen[from])
+              throw std::invalid_argument("apply_delta: permutazione non valida");
+            seen[from] = true;
+            slots[i] = current[from];
+          }
+          used = n;
+          alive = rank_tree(total, n);
+          break;
+        }
+        case delta::add_arc:
+        case delta::remove_arc: {
+          size_type src = readVarint(p, end);
+          size_type dest = readVarint(p, end);
+          if (src >= alive.count() || dest >= alive.count())
+            throw std::invalid_argument("apply_delta: indice non valido");
+          arc_op a = { slots[alive.find(src)], slots[alive.find(dest)],
+                       op == delta::add_arc };
+          arcs.push_back(a);
+          break;
+        }
+        default:
+          throw std::invalid_argument("apply_delta: opcode sconosciuto");
+      }
+    }
+    if (next_node != added)
+      throw std::invalid_argument("apply_delta: nodi in eccesso nel delta");
+
+    // origin[i]: da dove arriva il nodo i dopo il delta
+    std::vector<size_type> origin;
+    origin.reserve(alive.count());
+    for (std::size_t slot = 0; slot < used; ++slot)
+      if (live[slots[slot]])
+        origin.push_back(slots[slot]);
+
+    // posizione finale di ogni origine, npos se rimossa
+    std::vector<size_type> position(total, npos);
+    for (size_type i = 0; i < origin.size(); ++i)
+      position[origin[i]] = i;
+
+    std::size_t kept = 0;
+    for (std::size_t k = 0; k < arcs.size(); ++k) {
+      size_type src = position[arcs[k].src];
+      size_type dest = position[arcs[k].dest];
+      if (src == npos || dest == npos)
+        continue;
+      if (!Directed && src > dest)
+        std::swap(src, dest);
+      arcs[kept].src = src;
+      arcs[kept].dest = dest;
+      arcs[kept].add = arcs[k].add;
+      ++kept;
+    }
+    arcs.resize(kept);
+    // stabile: sulla stessa cella resta l'ordine originale
+    std::stable_sort(arcs.begin(), arcs.end(),
+      [](const arc_op &a, const arc_op &b) {
+        return a.src < b.src || (a.src == b.src && a.dest < b.dest);
+      });
+
+    Amgraph tmp;
+    gather(origin, d._nodes.data(), tmp);
+    for (std::size_t k = 0; k < arcs.size(); ++k) {
+      if (arcs[k].add)
+        tmp.addEdge(arcs[k].src, arcs[k].dest);
+      else
+        tmp.removeEdge(arcs[k].src, arcs[k].dest);
+    }
 
-  bool exists(const value_type &node) const{
-    return (this->getVertexIndex(node) != -1);
+    journalAppend(d._records.data() + header, d._records.size() - header,
+                  d._nodes.data(), d._nodes.size());
+    swapStorage(tmp);
   }
-   /**
-    @brief connected 
-    
-    Dato due identificativi di un nodo restituisce se è presente un collegamento diretto tra i due:
 
-    Trova gli indici dei nodi e si affida a funzioni private:
+  /**
+    @brief Strategie di riordino dei vertici
 
-    @see getVertexIndex
-    @see hasEdge
-    
-    @param node1 riferimento costante a value_type
-    @param node2 riferimento costante a value_type
+      - reverse_cuthill_mckee: BFS da un nodo di grado minimo, vicini per
+        grado crescente, ordine finale invertito. Riduce la banda della
+        matrice: gli archi finiscono vicino alla diagonale.
+      - degree_sort: grado decrescente, i nodi più connessi per primi.
+      - bfs_order: ordine di visita in ampiezza a partire dal nodo 0.
 
-    @returns false se non trovato
+    Per il grafo orientato gli archi si considerano non orientati,
+    come in connected.
   */
+  enum reorder_strategy { reverse_cuthill_mckee, degree_sort, bfs_order };
 
+  /**
+    @brief Calcola una permutazione dei vertici senza applicarla
 
+    @param strategy strategia di riordino
 
-  bool connected(const value_type &node1, const value_type &node2) const{
-    int index1 = this->getVertexIndex(node1);
-    int index2 = this->getVertexIndex(node2);
-    if (index1 == -1 || index2 == -1){
-      throw std::invalid_argument("Connected: Nodi non esistenti, c'è un errore di logica");
+    @return perm, con perm[nuovo indice] = vecchio indice
+  */
+  std::vector<size_type> ordering(reorder_strategy strategy) const {
+    std::vector<std::vector<size_type> > adj(_size);
+    for (size_type i = 0; i < _size; ++i)
+      for (size_type j = i + 1; j < _size; ++j)
+        if (hasEdge(i, j) || (Directed && hasEdge(j, i))) {
+          adj[i].push_back(j);
+          adj[j].push_back(i);
+        }
+
+    std::vector<size_type> perm;
+    perm.reserve(_size);
+
+    if (strategy == degree_sort) {
+      for (size_type i = 0; i < _size; ++i)
+        perm.push_back(i);
+      std::stable_sort(perm.begin(), perm.end(),
+        [&adj](size_type a, size_type b) {
+          return adj[a].size() > adj[b].size();
+        });
+      return perm;
     }
-    if  (this->hasEdge(index1,index2)||
-        (this->hasEdge(index2,index1)))
-          return true;
-    return false;
+
+    const bool rcm = (strategy == reverse_cuthill_mckee);
+    if (rcm)
+      for (size_type i = 0; i < _size; ++i)
+        std::stable_sort(adj[i].begin(), adj[i].end(),
+          [&adj](size_type a, size_type b) {
+            return adj[a].size() < adj[b].size();
+          });
+
+    // una visita per ogni componente connessa
+    std::vector<bool> visited(_size, false);
+    for (;;) {
+      size_type start = _size;
+      for (size_type i = 0; i < _size; ++i)
+        if (!visited[i] &&
+            (start == _size || (rcm && adj[i].size() < adj[start].size())))
+          start = i;
+      if (start == _size)
+        break;
+
+      std::size_t head = perm.size();
+      perm.push_back(start);
+      visited[start] = true;
+      while (head < perm.size()) {
+        size_type v = perm[head++];
+        for (std::size_t k = 0; k < adj[v].size(); ++k)
+          if (!visited[adj[v][k]]) {
+            visited[adj[v][k]] = true;
+            perm.push_back(adj[v][k]);
+          }
+      }
+    }
+
+    if (rcm)
+      std::reverse(perm.begin(), perm.end());
+    return perm;
+  }
+
+  /**
+    @brief Applica una permutazione ai vertici
+
+    Vertici e matrice vengono ricostruiti con un solo passaggio di
+    gather e sostituiti in blocco. Invalida gli handle.
+
+    @param perm permutazione con perm[nuovo indice] = vecchio indice
+
+    @throw std::invalid_argument se perm non è una permutazione di
+      [0, getSize())
+  */
+  void permute(const std::vector<size_type> &perm) {
+    if (perm.size() != _size)
+      throw std::invalid_argument("permute: dimensione errata");
+    std::vector<bool> seen(_size, false);
+    for (size_type i = 0; i < _size; ++i) {
+      if (perm[i] >= _size || seen[perm[i]])
+        throw std::invalid_argument("permute: non è una permutazione");
+      seen[perm[i]] = true;
+    }
+
+    Amgraph tmp;
+    gather(perm, nullptr, tmp);
+
+    if (_journaling) {
+      std::vector<unsigned char> record(1, delta::permute);
+      writeVarint(record, _size);
+      for (size_type i = 0; i < _size; ++i)
+        writeVarint(record, perm[i]);
+      journalAppend(record.data(), record.size());
+    }
+
+    swapStorage(tmp);
+  }
+
+  /**
+    @brief Riordina i vertici per località
+
+    @see ordering
+    @see permute
+
+    @param strategy strategia di riordino
+
+    @return la permutazione applicata (perm[nuovo] = vecchio)
+  */
+  std::vector<size_type> reorder(reorder_strategy strategy) {
+    std::vector<size_type> perm = ordering(strategy);
+    permute(perm);
+    return perm;
+  }
+
+  /**
+    @brief Vista non proprietaria su un sottoinsieme di vertici
+
+    Filtra i vertici del grafo con una maschera di bit senza copiare
+    nulla: handle e indici restano quelli del grafo originale.
+    Offre la stessa interfaccia di traversal di Amgraph (getSize,
+    handle, contains, neighbors) e si può passare a breadth_first.
+
+    La vista fa riferimento al grafo: non deve sopravvivergli e viene
+    invalidata da remove_Node e permute.
+  */
+  class subgraph_view {
+  public:
+    typedef Amgraph::vertex_handle vertex_handle;
+    typedef Amgraph::size_type size_type;
+    typedef Amgraph::value_type value_type;
+
+    /**
+      @brief Iteratore sui vicini che appartengono alla vista
+    */
+    class neighbor_iterator {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef vertex_handle             value_type;
+      typedef ptrdiff_t                 difference_type;
+      typedef const vertex_handle*      pointer;
+      typedef vertex_handle             reference;
+
+      neighbor_iterator() : _view(nullptr) { }
+
+      reference operator*() const {
+        return *_it;
+      }
+
+      neighbor_iterator operator++(int) {
+        neighbor_iterator old(*this);
+        ++(*this);
+        return old;
+      }
+
+      neighbor_iterator &operator++() {
+        ++_it;
+        skip();
+        return *this;
+      }
+
+      bool operator==(const neighbor_iterator &other) const {
+        return _it == other._it;
+      }
+
+      bool operator!=(const neighbor_iterator &other) const {
+        return _it != other._it;
+      }
+
+    private:
+      const subgraph_view *_view;
+      typename Amgraph::neighbor_iterator _it;
+      typename Amgraph::neighbor_iterator _end;
+
+      friend class subgraph_view;
+
+      neighbor_iterator(const subgraph_view *view,
+                        const typename Amgraph::neighbor_iterator &it,
+                        const typename Amgraph::neighbor_iterator &end)
+        : _view(view), _it(it), _end(end) {
+        skip();
+      }
+
+      void skip() {
+        while (_it != _end && !_view->contains(*_it))
+          ++_it;
+      }
+    }; // fine della classe subgraph_view::neighbor_iterator
+
+    typedef amgraph_range<neighbor_iterator> neighbor_range;
+
+    /**
+      @brief Vista vuota su graph
+
+      @param graph grafo osservato
+    */
+    explicit subgraph_view(const Amgraph &graph)
+      : _graph(&graph), _mask(graph.getSize(), false), _count(0) { }
+
+    /**
+      @brief Aggiunge un vertice alla vista
+    */
+    void include(vertex_handle h) {
+      assert(h.index() < _mask.size());
+      if (!_mask[h.index()]) {
+        _mask[h.index()] = true;
+        ++_count;
+      }
+    }
+
+    /**
+      @brief Toglie un vertice dalla vista
+    */
+    void exclude(vertex_handle h) {
+      assert(h.index() < _mask.size());
+      if (_mask[h.index()]) {
+        _mask[h.index()] = false;
+        --_count;
+      }
+    }
+
+    /**
+      @brief true se il vertice appartiene alla vista
+    */
+    bool contains(vertex_handle h) const {
+      return _graph->contains(h) && h.index() < _mask.size() && _mask[h.index()];
+    }
+
+    /**
+      @brief Numero di vertici nella vista
+    */
+    size_type count() const {
+      return _count;
+    }
+
+    /**
+      @brief Spazio degli indici (quello del grafo originale)
+    */
+    size_type getSize() const {
+      return static_cast<size_type>(_mask.size());
+    }
+
+    vertex_handle handle(size_type index) const {
+      return _graph->handle(index);
+    }
+
+    const value_type &value(vertex_handle h) const {
+      return _graph->value(h);
+    }
+
+    /**
+      @brief connected ristretto alla vista
+
+      @return false se uno dei due nodi è fuori dalla vista
+    */
+    bool connected(vertex_handle h1, vertex_handle h2) const {
+      return contains(h1) && contains(h2) && _graph->connected(h1, h2);
+    }
+
+    /**
+      @brief Vicini di h che appartengono alla vista
+
+      @pre contains(h)
+    */
+    neighbor_range neighbors(vertex_handle h) const {
+      assert(contains(h));
+      typename Amgraph::neighbor_range all = _graph->neighbors(h);
+      return neighbor_range(neighbor_iterator(this, all.begin(), all.end()),
+                            neighbor_iterator(this, all.end(), all.end()));
+    }
+
+    /**
+      @brief Grafo osservato
+    */
+    const Amgraph &graph() const {
+      return *_graph;
+    }
+
+  private:
+    const Amgraph *_graph;
+    std::vector<bool> _mask;
+    size_type _count;
+  }; // fine della classe subgraph_view
+
+  /**
+    @brief Vista sui nodi di un range
+
+    @param start iteratore al primo value_type
+    @param end iteratore di fine
+
+    @throw std::invalid_argument se un nodo non esiste
+  */
+  template<typename Iter>
+  subgraph_view make_view(Iter start, Iter end) const {
+    subgraph_view view(*this);
+    for (; start != end; ++start) {
+      int index = this->getVertexIndex(*start);
+      if (index == -1)
+        throw std::invalid_argument("make_view: Nodi non esistenti");
+      view.include(vertex_handle(index, _generation));
+    }
+    return view;
+  }
+
+  /**
+    @brief Sottografo indotto da un range di nodi
+
+    Il nuovo grafo contiene i nodi del range (i duplicati contano una
+    volta) e tutti gli archi tra di essi. I nodi mantengono l'ordine
+    relativo che avevano in questo grafo, così le righe vengono lette
+    in sequenza da un solo gather.
+
+    @param start iteratore al primo value_type
+    @param end iteratore di fine
+
+    @return il sottografo, indipendente da questo
+
+    @throw std::invalid_argument se un nodo non esiste
+  */
+  template<typename Iter>
+  Amgraph induced_subgraph(Iter start, Iter end) const {
+    return induced_subgraph(make_view(start, end));
+  }
+
+  /**
+    @brief Materializza una vista in un grafo compatto
+
+    @pre &view.graph() == this
+  */
+  Amgraph induced_subgraph(const subgraph_view &view) const {
+    assert(&view.graph() == this);
+    std::vector<size_type> map;
+    map.reserve(view.count());
+    for (size_type i = 0; i < view.getSize(); ++i)
+      if (view.contains(vertex_handle(i, _generation)))
+        map.push_back(i);
+
+    Amgraph out;
+    gather(map, nullptr, out);
+    return out;
+  }
+
+  /**
+    @brief true se h riferisce un nodo di questo grafo
+
+    Falso per gli handle nulli, per quelli di un altro grafo e per
+    quelli creati prima di un cambio di generazione. Interfaccia
+    comune con subgraph_view.
+  */
+  bool contains(vertex_handle h) const {
+    return h.generation() == _generation && h.index() < _size;
+  }
+
+  /**
+    @brief Unione di due grafi
+
+    Nodi: quelli di a seguiti da quelli di b che non sono in a.
+    Archi: presenti in a oppure in b.
+    I nodi vengono allineati per valore una volta sola, poi le righe
+    di b vengono lette attraverso l'allineamento e combinate con
+    quelle del risultato, in parallelo a blocchi di righe.
+  */
+  friend Amgraph graph_union(const Amgraph &a, const Amgraph &b) {
+    return combine(a, b, combine_or);
+  }
+
+  /**
+    @brief Intersezione di due grafi
+
+    Nodi: quelli comuni, nell'ordine di a.
+    Archi: presenti sia in a che in b.
+
+    @see graph_union
+  */
+  friend Amgraph graph_intersection(const Amgraph &a, const Amgraph &b) {
+    return combine(a, b, combine_and);
+  }
+
+  /**
+    @brief Differenza di due grafi
+
+    Nodi: quelli di a.
+    Archi: presenti in a ma non in b.
+
+    @see graph_union
+  */
+  friend Amgraph graph_difference(const Amgraph &a, const Amgraph &b) {
+    return combine(a, b, combine_andnot);
+  }
+
+  /**
+    @brief Inverte la direzione di tutti gli archi
+
+    La matrice viene trasposta a blocchi quadrati, così che sia le
+    righe lette che quelle scritte restino in cache; i blocchi di
+    righe di destinazione sono distribuiti tra i thread.
+    Nel grafo non orientato non fa nulla.
+  */
+  void transpose() {
+    if constexpr (Directed) {
+      const size_type block = 64;
+      Amgraph tmp;
+      tmp._adjacencyMatrix = new bool*[_size]();
+      tmp._size = _size;
+      for (size_type i = 0; i < _size; ++i)
+        tmp._adjacencyMatrix[i] = new bool[_size];
+
+      bool **src = _adjacencyMatrix;
+      bool **dst = tmp._adjacencyMatrix;
+      const size_type n = _size;
+      parallelFor((n + block - 1) / block, 4,
+        [src, dst, n, block](std::size_t first, std::size_t last) {
+          for (size_type jb = first * block; jb < last * block && jb < n; jb += block)
+            for (size_type ib = 0; ib < n; ib += block)
+              for (size_type j = jb; j < jb + block && j < n; ++j)
+                for (size_type i = ib; i < ib + block && i < n; ++i)
+                  dst[j][i] = src[i][j];
+        });
+
+      logDiff(tmp);
+      std::swap(_adjacencyMatrix, tmp._adjacencyMatrix);
+    }
+  }
+
+  /**
+    @brief Complemento del grafo
+
+    Ogni coppia di nodi distinti diventa collegata se e solo se non lo
+    era. I cappi (archi da un nodo a se stesso) vengono rimossi.
+  */
+  void complement() {
+    Amgraph tmp;
+    const size_type n = _size;
+    if constexpr (Directed) {
+      tmp._adjacencyMatrix = new bool*[n]();
+      tmp._size = n;
+      for (size_type i = 0; i < n; ++i) {
+        tmp._adjacencyMatrix[i] = new bool[n];
+        std::memcpy(tmp._adjacencyMatrix[i], _adjacencyMatrix[i], n);
+      }
+      bool **rows = tmp._adjacencyMatrix;
+      parallelFor(n, 256, [rows, n](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          flipBools(reinterpret_cast<unsigned char *>(rows[i]), n);
+          rows[i][i] = false;
+        }
+      });
+    }
+    else {
+      const std::size_t bytes = halfBytes(n);
+      tmp._halfMatrix = new unsigned char[bytes];
+      tmp._size = n;
+      if (bytes > 0)
+        std::memcpy(tmp._halfMatrix, _halfMatrix, bytes);
+      unsigned char *bits = tmp._halfMatrix;
+      parallelFor(bytes, 1 << 16, [bits](std::size_t first, std::size_t last) {
+        combineWords<combine_xor>(bits + first, nullptr, last - first);
+      });
+      for (size_type i = 0; i < n; ++i)
+        clearBit(bits, halfBit(i, i));
+      // i bit oltre il triangolo devono restare a zero
+      const std::size_t used = static_cast<std::size_t>(n) * (n + 1) / 2;
+      for (std::size_t k = used; k < bytes * 8; ++k)
+        clearBit(bits, k);
+    }
+
+    logDiff(tmp);
+    std::swap(_adjacencyMatrix, tmp._adjacencyMatrix);
+    std::swap(_halfMatrix, tmp._halfMatrix);
+  }
+
+  private:
+  /**
+   @brief gather: costruisce un grafo riordinando/filtrando questo
+
+    Il nodo i di out è il nodo map[i] di questo grafo, con i suoi archi
+    verso gli altri nodi selezionati; se map[i] >= _size è un nodo
+    nuovo e isolato con valore extra[map[i] - _size].
+    Tutta l'allocazione avviene su out: in caso di eccezione questo
+    grafo non viene toccato.
+
+    @param map origine di ogni nodo di out
+    @param extra valori dei nodi nuovi (può essere nullptr se non ce ne sono)
+    @param out grafo vuoto di destinazione
+
+    */
+  void gather(const std::vector<size_type> &map, const value_type *extra,
+              Amgraph &out) const {
+      const size_type n = static_cast<size_type>(map.size());
+      assert(out._size == 0);
+      AMGRAPH_METRIC(++_metrics.reallocations;)
+
+      out._vertices = new value_type[n];
+      if constexpr (Directed)
+        out._adjacencyMatrix = new bool*[n]();
+      else
+        out._halfMatrix = new unsigned char[halfBytes(n)]();
+      out._size = n;
+
+      for (size_type i = 0; i < n; ++i)
+        out._vertices[i] = (map[i] < _size) ? _vertices[map[i]]
+                                            : extra[map[i] - _size];
+
+      if constexpr (Directed) {
+        for (size_type i = 0; i < n; ++i) {
+          bool *row = new bool[n]();
+          out._adjacencyMatrix[i] = row;
+          if (map[i] >= _size)
+            continue;
+          const bool *src = _adjacencyMatrix[map[i]];
+          for (size_type j = 0; j < n; ++j)
+            if (map[j] < _size)
+              row[j] = src[map[j]];
+        }
+      }
+      else {
+        for (size_type j = 0; j < n; ++j) {
+          if (map[j] >= _size)
+            continue;
+          for (size_type i = 0; i <= j; ++i)
+            if (map[i] < _size && testBit(_halfMatrix, halfBit(map[i], map[j])))
+              setBit(out._halfMatrix, halfBit(i, j));
+        }
+      }
+      out.rebuildIndex();
+  }
+
+  /**
+   @brief Albero di Fenwick su slot accesi o spenti
+
+    find(k) restituisce il k-esimo slot acceso (da 0) in O(log n):
+    apply_delta lo usa per tradurre gli indici dei record in slot
+    senza spostare elementi a ogni rimozione.
+
+    */
+  class rank_tree {
+  public:
+    /**
+      @brief n slot, accesi i primi on
+    */
+    rank_tree(std::size_t n, std::size_t on)
+      : _tree(n + 1, 0), _count(static_cast<size_type>(on)), _top(1) {
+      for (std::size_t i = 1; i <= n; ++i) {
+        // _tree[i] conta gli slot accesi in (i - lowbit(i), i]
+        std::size_t low = i - (i & (~i + 1));
+        std::size_t high = std::min(i, on);
+        _tree[i] = static_cast<size_type>(high > low ? high - low : 0);
+      }
+      while (_top * 2 <= n)
+        _top *= 2;
+    }
+
+    size_type count() const {
+      return _count;
+    }
+
+    /**
+      @brief Accende (change = 1) o spegne (change = -1) uno slot
+    */
+    void add(std::size_t slot, int change) {
+      _count += static_cast<size_type>(change);
+      for (std::size_t i = slot + 1; i < _tree.size(); i += i & (~i + 1))
+        _tree[i] += static_cast<size_type>(change);
+    }
+
+    /**
+      @pre k < count()
+    */
+    std::size_t find(size_type k) const {
+      std::size_t pos = 0;
+      for (std::size_t step = _top; step > 0; step >>= 1)
+        if (pos + step < _tree.size() && _tree[pos + step] <= k) {
+          pos += step;
+          k -= _tree[pos];
+        }
+      return pos;
+    }
+
+  private:
+    std::vector<size_type> _tree; ///< indici da 1
+    size_type _count;
+    std::size_t _top; ///< massima potenza di 2 <= n
+  }; // fine della classe rank_tree
+
+  /**
+   @brief Buffer di lavoro di una mutazione
+
+    Nodi e matrice nuovi si costruiscono qui; commit() li scambia con
+    quelli del grafo senza poter lanciare e il distruttore libera i
+    vecchi. Se qualcosa lancia prima del commit il distruttore libera
+    il lavoro parziale e il grafo non è stato toccato: garanzia forte
+    senza blocchi catch che liberano le righe una per una.
+
+    */
+  struct scratch {
+    value_type *vertices;
+    size_type size;
+    bool **rows;         ///< matrice completa (solo Directed)
+    unsigned char *half; ///< triangolo a bit (solo !Directed)
+
+    scratch() : vertices(nullptr), size(0), rows(nullptr), half(nullptr) { }
+
+    /**
+      @brief Alloca n nodi e una matrice n x n senza archi
+
+      Delega al costruttore vuoto: se un'allocazione lancia viene
+      comunque chiamato ~scratch.
+    */
+    explicit scratch(size_type n) : scratch() {
+      vertices = new value_type[n];
+      if constexpr (Directed) {
+        rows = new bool*[n]();
+        size = n;
+        for (size_type i = 0; i < n; ++i)
+          rows[i] = new bool[n]();
+      }
+      else {
+        half = new unsigned char[halfBytes(n)]();
+        size = n;
+      }
+    }
+
+    ~scratch() {
+      delete[] vertices;
+      if (rows != nullptr)
+        for (size_type i = 0; i < size; ++i)
+          delete[] rows[i];
+      delete[] rows;
+      delete[] half;
+    }
+
+  private:
+    scratch(const scratch &);
+    scratch &operator=(const scratch &);
+  };
+
+  /**
+   @brief Sostituisce nodi e matrice con quelli di s (non lancia)
+
+    s riceve i vecchi e li libera alla distruzione.
+
+    */
+  void commit(scratch &s) {
+      std::swap(_vertices, s.vertices);
+      std::swap(_size, s.size);
+      std::swap(_adjacencyMatrix, s.rows);
+      std::swap(_halfMatrix, s.half);
+  }
+
+  /**
+   @brief Scambia nodi, matrice, indice diretto e generazione con other
+
+    Journal e metriche restano dove sono. La generazione segue gli
+    indici: chi riceve il contenuto di un grafo nuovo (apply_delta,
+    permute, Amgraph_builder) ne prende anche la generazione.
+
+    */
+  void swapStorage(Amgraph &other) {
+      std::swap(_vertices, other._vertices);
+      std::swap(_size, other._size);
+      std::swap(_adjacencyMatrix, other._adjacencyMatrix);
+      std::swap(_halfMatrix, other._halfMatrix);
+      _direct.swap(other._direct);
+      std::swap(_offset, other._offset);
+      std::swap(_directMapped, other._directMapped);
+      std::swap(_generation, other._generation);
+  }
+
+  /**
+   @brief Lancia std::invalid_argument se h non è valido per questo grafo
+
+    */
+  void requireHandle(vertex_handle h) const {
+      if (!contains(h))
+        throw std::invalid_argument("Handle non valido, c'è un errore di logica");
+  }
+
+  static constexpr bool direct_index = amgraph_direct_index<T>::value;
+
+  /**
+   @brief Dimensione massima della tabella diretta per count nodi
+
+    Oltre questa soglia gli identificativi non sono densi e si torna
+    alla ricerca lineare.
+
+    */
+  static std::size_t directLimit(std::size_t count) {
+      return 4 * count + 64;
+  }
+
+  /**
+   @brief Posizione di node nella tabella diretta
+
+    @returns _direct.size() se node è fuori dall'intervallo coperto
+    */
+  std::size_t directSlot(const value_type &node) const {
+      if constexpr (direct_index) {
+        typedef typename std::make_unsigned<value_type>::type unsigned_type;
+        if (node < _offset)
+          return _direct.size();
+        unsigned_type distance = static_cast<unsigned_type>(
+          static_cast<unsigned_type>(node) - static_cast<unsigned_type>(_offset));
+        if (distance >= _direct.size())
+          return _direct.size();
+        return static_cast<std::size_t>(distance);
+      }
+      else {
+        return 0;
+      }
+  }
+
+  /**
+   @brief Indice di node secondo la tabella diretta
+
+    @returns -1 se node non è nel grafo
+    @pre _directMapped
+    */
+  int directLookup(const value_type &node) const {
+      std::size_t slot = directSlot(node);
+      return slot == _direct.size() ? -1 : _direct[slot];
+  }
+
+  /**
+   @brief Allarga la tabella diretta perché copra node
+
+    Può lanciare std::bad_alloc, per questo add_Node la chiama prima di
+    modificare il grafo. Se i nodi diventano troppo sparsi l'indice
+    diretto viene abbandonato fino a quando il grafo non torna vuoto.
+
+    */
+  void reserveIndex(const value_type &node) {
+      if constexpr (direct_index) {
+        typedef typename std::make_unsigned<value_type>::type unsigned_type;
+        if (_size == 0) {
+          _directMapped = true;
+          _direct.assign(1, -1);
+          _offset = node;
+          return;
+        }
+        if (!_directMapped)
+          return;
+        if (directSlot(node) != _direct.size())
+          return;
+
+        // posizioni da aggiungere in testa o in coda alla tabella
+        std::size_t front = 0;
+        std::size_t needed = _direct.size();
+        if (node < _offset) {
+          front = static_cast<unsigned_type>(
+            static_cast<unsigned_type>(_offset) - static_cast<unsigned_type>(node));
+          needed += front;
+        }
+        else {
+          needed = static_cast<std::size_t>(static_cast<unsigned_type>(
+            static_cast<unsigned_type>(node) - static_cast<unsigned_type>(_offset))) + 1;
+        }
+        // la differenza può non stare in size_t: anche quello è "sparso"
+        if (needed < _direct.size() || needed > directLimit(_size + 1)) {
+          _directMapped = false;
+          std::vector<int>().swap(_direct);
+          return;
+        }
+
+        // margine geometrico dal lato verso cui si cresce, così anche
+        // gli identificativi consecutivi decrescenti non riallocano
+        // a ogni nodo
+        std::size_t size = std::min(std::max(needed, 2 * _direct.size()),
+                                    directLimit(_size + 1));
+        std::size_t slack = size - needed;
+        if (front != 0) {
+          // in testa il margine si ferma al minimo di T
+          unsigned_type room = static_cast<unsigned_type>(
+            static_cast<unsigned_type>(node) -
+            static_cast<unsigned_type>(std::numeric_limits<value_type>::min()));
+          if (static_cast<std::uintmax_t>(room) < slack)
+            slack = static_cast<std::size_t>(room);
+          size = needed + slack;
+          front += slack;
+        }
+
+        std::vector<int> table(size, -1);
+        std::copy(_direct.begin(), _direct.end(), table.begin() + front);
+        _direct.swap(table);
+        if (front != 0)
+          _offset = static_cast<value_type>(
+            static_cast<unsigned_type>(static_cast<unsigned_type>(node) - slack));
+      }
+  }
+
+  /**
+   @brief Registra node all'indice index (dopo reserveIndex)
+
+    */
+  void setIndex(const value_type &node, size_type index) {
+      if constexpr (direct_index) {
+        if (_directMapped)
+          _direct[directSlot(node)] = static_cast<int>(index);
+      }
+  }
+
+  /**
+   @brief Aggiorna la tabella dopo la rimozione di node da index
+
+    I nodi successivi sono scalati di una posizione. Un grafo rimasto
+    vuoto torna all'indice diretto anche se i nodi erano sparsi.
+
+    */
+  void eraseIndex(const value_type &node, size_type index) {
+      if constexpr (direct_index) {
+        if (_size == 0) {
+          std::vector<int>().swap(_direct);
+          _directMapped = true;
+          return;
+        }
+        if (!_directMapped)
+          return;
+        _direct[directSlot(node)] = -1;
+        for (size_type i = index; i < _size; ++i)
+          _direct[directSlot(_vertices[i])] = static_cast<int>(i);
+      }
+  }
+
+  /**
+   @brief Ricostruisce la tabella diretta da _vertices
+
+    */
+  void rebuildIndex() {
+      if constexpr (direct_index) {
+        typedef typename std::make_unsigned<value_type>::type unsigned_type;
+        std::vector<int>().swap(_direct);
+        _directMapped = true;
+        if (_size == 0)
+          return;
+        value_type low = _vertices[0];
+        value_type high = _vertices[0];
+        for (size_type i = 1; i < _size; ++i) {
+          low = std::min(low, _vertices[i]);
+          high = std::max(high, _vertices[i]);
+        }
+        unsigned_type span = static_cast<unsigned_type>(
+          static_cast<unsigned_type>(high) - static_cast<unsigned_type>(low));
+        if (span >= directLimit(_size)) {
+          _directMapped = false;
+          return;
+        }
+        _direct.assign(static_cast<std::size_t>(span) + 1, -1);
+        _offset = low;
+        for (size_type i = 0; i < _size; ++i)
+          _direct[directSlot(_vertices[i])] = static_cast<int>(i);
+      }
+  }
+
+  enum combine_op { combine_or, combine_and, combine_andnot, combine_xor };
+
+  /**
+   @brief Combina due grafi allineando i nodi per valore
+
+    Ogni nodo di b viene cercato in a una volta sola con resolveBatch
+    (indice diretto o tabella hash; confronti a coppie solo se T non
+    ha std::hash). Il risultato nasce da un gather di a, poi ogni sua
+    cella si combina con la cella corrispondente di b letta dalle
+    righe originali: b non viene copiato, per cui la memoria di picco
+    è quella del risultato.
+
+    */
+  static Amgraph combine(const Amgraph &a, const Amgraph &b, combine_op op) {
+      const size_type npos = static_cast<size_type>(-1);
+
+      // posizione in a di ogni nodo di b e viceversa
+      std::vector<int> a_of_b(b._size);
+      a.resolveBatch(b._size, [&b](std::size_t j) -> const value_type & {
+        return b._vertices[j];
+      }, a_of_b.data());
+      std::vector<size_type> b_of_a(a._size, npos);
+      for (size_type j = 0; j < b._size; ++j)
+        if (a_of_b[j] != -1)
+          b_of_a[a_of_b[j]] = j;
+
+      // map_a[k]: origine del nodo k del risultato in a (oltre a._size
+      // si pesca il valore da b); col[k]: il nodo k in b, npos se manca
+      std::vector<size_type> map_a, col;
+      for (size_type i = 0; i < a._size; ++i) {
+        if (op == combine_and && b_of_a[i] == npos)
+          continue;
+        map_a.push_back(i);
+        col.push_back(b_of_a[i]);
+      }
+      if (op == combine_or)
+        for (size_type j = 0; j < b._size; ++j)
+          if (a_of_b[j] == -1) {
+            map_a.push_back(a._size + j);
+            col.push_back(j);
+          }
+
+      Amgraph out;
+      a.gather(map_a, b._vertices, out);
+
+      const size_type n = out._size;
+      if constexpr (Directed) {
+        bool **dst = out._adjacencyMatrix;
+        parallelFor(n, 256, [dst, &b, &col, n, op](std::size_t first, std::size_t last) {
+          for (std::size_t i = first; i < last; ++i) {
+            const bool *src = col[i] != npos ? b._adjacencyMatrix[col[i]] : nullptr;
+            switch (op) {
+              case combine_or:     combineGathered<combine_or>(dst[i], src, col.data(), n); break;
+              case combine_and:    combineGathered<combine_and>(dst[i], src, col.data(), n); break;
+              case combine_andnot: combineGathered<combine_andnot>(dst[i], src, col.data(), n); break;
+              case combine_xor:    break;
+            }
+          }
+        });
+      }
+      else {
+        // ogni thread scrive solo i byte del proprio intervallo
+        unsigned char *dst = out._halfMatrix;
+        const std::size_t bits = static_cast<std::size_t>(n) * (n + 1) / 2;
+        parallelFor(halfBytes(n), 1 << 16,
+          [dst, &b, &col, bits, op](std::size_t first, std::size_t last) {
+            std::size_t pos = first * 8;
+            const std::size_t stop = std::min(last * 8, bits);
+            if (pos >= stop)
+              return;
+            // cella (i, j) del bit pos: il triangolo è per colonne
+            std::size_t j = static_cast<std::size_t>((std::sqrt(8.0 * pos + 1) - 1) / 2);
+            while (j * (j + 1) / 2 > pos)
+              --j;
+            while ((j + 1) * (j + 2) / 2 <= pos)
+              ++j;
+            std::size_t i = pos - j * (j + 1) / 2;
+            for (; pos < stop; ++pos) {
+              bool x = testBit(dst, pos);
+              bool y = col[i] != npos && col[j] != npos &&
+                       testBit(b._halfMatrix, halfBit(col[i], col[j]));
+              bool r = op == combine_or ? (x || y)
+                     : op == combine_and ? (x && y)
+                     : (x && !y);
+              if (r != x) {
+                if (r)
+                  setBit(dst, pos);
+                else
+                  clearBit(dst, pos);
+              }
+              if (++i > j) {
+                ++j;
+                i = 0;
+              }
+            }
+          });
+      }
+      return out;
+  }
+
+  /**
+   @brief dst[k] = dst[k] op src[col[k]] per k < n
+
+    src è la riga di b del nodo, nullptr se b non lo contiene; una
+    colonna npos vale false.
+
+    */
+  template <combine_op Op>
+  static void combineGathered(bool *dst, const bool *src, const size_type *col,
+                              std::size_t n) {
+      const size_type npos = static_cast<size_type>(-1);
+      for (std::size_t k = 0; k < n; ++k) {
+        bool y = src != nullptr && col[k] != npos && src[col[k]];
+        dst[k] = (apply<Op>(dst[k], y) & 1) != 0;
+      }
+  }
+
+  /**
+   @brief dst = dst op src a parole di 64 bit; con combine_xor src
+    è ignorato e si invertono tutti i bit di dst
+
+    */
+  template <combine_op Op>
+  static void combineWords(unsigned char *dst, const unsigned char *src,
+                           std::size_t n) {
+      std::size_t k = 0;
+      for (; k + 8 <= n; k += 8) {
+        std::uint64_t x, y = 0;
+        std::memcpy(&x, dst + k, 8);
+        if (Op != combine_xor)
+          std::memcpy(&y, src + k, 8);
+        x = apply<Op>(x, y);
+        std::memcpy(dst + k, &x, 8);
+      }
+      for (; k < n; ++k)
+        dst[k] = static_cast<unsigned char>(
+          apply<Op>(dst[k], Op != combine_xor ? src[k] : 0));
+  }
+
+  template <combine_op Op>
+  static std::uint64_t apply(std::uint64_t x, std::uint64_t y) {
+      if (Op == combine_or)
+        return x | y;
+      if (Op == combine_and)
+        return x & y;
+      if (Op == combine_andnot)
+        return x & ~y;
+      return ~x;
+  }
+
+  /**
+   @brief Inverte una riga di bool (0 <-> 1 per byte)
+
+    */
+  static void flipBools(unsigned char *row, std::size_t n) {
+      const std::uint64_t ones = 0x0101010101010101ull;
+      std::size_t k = 0;
+      for (; k + 8 <= n; k += 8) {
+        std::uint64_t x;
+        std::memcpy(&x, row + k, 8);
+        x ^= ones;
+        std::memcpy(row + k, &x, 8);
+      }
+      for (; k < n; ++k)
+        row[k] ^= 1;
+  }
+
+  /**
+   @brief previous[k]: posizione in nodes dell'occorrenza precedente
+    di nodes[k], -1 se è la prima
+
+    Con std::hash<T> una tabella a indirizzamento aperto come
+    resolveBatch, O(nodes.size()); altrimenti confronti a coppie.
+
+    */
+  static void previousEqual(const std::vector<value_type> &nodes,
+                            std::vector<int> &previous) {
+      const std::size_t count = nodes.size();
+      if constexpr (amgraph_is_hashable<T>::value) {
+        std::size_t mask = 1;
+        while (mask < 2 * count)
+          mask <<= 1;
+        --mask;
+        // table tiene l'ultima occorrenza di ogni valore
+        std::vector<int> table(mask + 1, -1);
+        std::hash<T> hasher;
+        for (std::size_t k = 0; k < count; ++k) {
+          previous[k] = -1;
+          std::size_t slot = hasher(nodes[k]) & mask;
+          for (; table[slot] != -1; slot = (slot + 1) & mask)
+            if (nodes[table[slot]] == nodes[k]) {
+              previous[k] = table[slot];
+              break;
+            }
+          table[slot] = static_cast<int>(k);
+        }
+      }
+      else {
+        for (std::size_t k = 0; k < count; ++k) {
+          previous[k] = -1;
+          for (std::size_t j = k; j-- > 0; )
+            if (nodes[j] == nodes[k]) {
+              previous[k] = static_cast<int>(j);
+              break;
+            }
+        }
+      }
+  }
+
+  /**
+   @brief Risolve count chiavi in indici (-1 se assenti)
+
+    key(k) restituisce la k-esima chiave. Con l'indice diretto ogni
+    ricerca è già O(1); altrimenti, se std::hash<T> esiste e il batch
+    non è minuscolo, si costruisce una tabella a indirizzamento aperto
+    dei nodi e la si interroga in parallelo.
+
+    */
+  template <typename Key>
+  void resolveBatch(std::size_t count, Key key, int *out) const {
+      bool linear = count < 16 || _size < 16;
+      if constexpr (direct_index)
+        linear = linear || _directMapped;
+      if constexpr (amgraph_is_hashable<T>::value) {
+        if (!linear) {
+          std::size_t mask = 1;
+          while (mask < 2 * std::size_t(_size))
+            mask <<= 1;
+          --mask;
+          std::vector<int> table(mask + 1, -1);
+          std::hash<T> hasher;
+          for (size_type i = 0; i < _size; ++i) {
+            std::size_t s = hasher(_vertices[i]) & mask;
+            while (table[s] != -1)
+              s = (s + 1) & mask;
+            table[s] = static_cast<int>(i);
+          }
+          parallelFor(count, 4096,
+            [this, &key, &table, mask, out](std::size_t first, std::size_t last) {
+              std::hash<T> hasher;
+              for (std::size_t k = first; k < last; ++k) {
+                const value_type &node = key(k);
+                out[k] = -1;
+                for (std::size_t s = hasher(node) & mask; table[s] != -1;
+                     s = (s + 1) & mask)
+                  if (_vertices[table[s]] == node) {
+                    out[k] = table[s];
+                    break;
+                  }
+              }
+            });
+          return;
+        }
+      }
+      for (std::size_t k = 0; k < count; ++k)
+        out[k] = getVertexIndex(key(k));
+  }
+
+  /**
+   @brief Indirizzo della cella (i, j), per il prefetch
+
+    */
+  const void *edgeAddress(size_type i, size_type j) const {
+      if constexpr (Directed)
+        return &_adjacencyMatrix[i][j];
+      else
+        return _halfMatrix + halfBit(i, j) / 8;
+  }
+
+  /**
+   @brief Esegue f(first, last) su blocchi di [0, count)
+
+    Usa più thread solo se ogni thread riceve almeno grain elementi.
+    Un'eccezione lanciata da f in un thread viene rilanciata qui dopo
+    aver atteso tutti i thread.
+
+    */
+  template <typename F>
+  static void parallelFor(std::size_t count, std::size_t grain, F f) {
+      std::size_t threads = std::thread::hardware_concurrency();
+      if (grain > 0 && count / grain < threads)
+        threads = count / grain;
+      if (threads <= 1) {
+        f(std::size_t(0), count);
+        return;
+      }
+      std::vector<std::thread> workers;
+      std::vector<std::exception_ptr> errors(threads);
+      workers.reserve(threads - 1);
+      const std::size_t chunk = (count + threads - 1) / threads;
+      try {
+        for (std::size_t t = 1; t < threads; ++t) {
+          std::size_t first = t * chunk;
+          std::size_t last = std::min(count, first + chunk);
+          if (first < last)
+            workers.push_back(std::thread([&f, &errors, t, first, last]() {
+              try {
+                f(first, last);
+              }
+              catch (...) {
+                errors[t] = std::current_exception();
+              }
+            }));
+        }
+        f(std::size_t(0), std::min(count, chunk));
+      }
+      catch (...) {
+        errors[0] = std::current_exception();
+      }
+      for (std::size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+      for (std::size_t t = 0; t < threads; ++t)
+        if (errors[t])
+          std::rethrow_exception(errors[t]);
+  }
+
+  /**
+   @brief Registra nel journal le differenze di archi verso next
+
+    next ha gli stessi nodi di questo grafo.
+
+    */
+  void logDiff(const Amgraph &next) {
+      if (!_journaling)
+        return;
+      const std::size_t records = _journal._records.size();
+      const std::size_t nodes = _journal._nodes.size();
+      try {
+        for (size_type i = 0; i < _size; ++i)
+          for (size_type j = Directed ? 0 : i; j < _size; ++j)
+            if (hasEdge(i, j) != next.hasEdge(i, j))
+              logRecord(next.hasEdge(i, j) ? delta::add_arc : delta::remove_arc, i, j);
+      }
+      catch (...) {
+        truncateJournal(records, nodes);
+        throw;
+      }
+  }
+
+  /**
+   @brief Registra l'aggiunta di un nodo nel journal
+
+    */
+  void logNode(const value_type &node) {
+      const unsigned char op = delta::add_node;
+      journalAppend(&op, 1, &node, 1);
+  }
+
+  /**
+   @brief Registra una mutazione con uno o due indici nel journal
+
+    */
+  void logRecord(typename delta::opcode op, size_type a,
+                 size_type b = static_cast<size_type>(-1)) {
+      if (!_journaling)
+        return;
+      unsigned char record[1 + 2 * max_varint];
+      std::size_t length = 0;
+      record[length++] = static_cast<unsigned char>(op);
+      length += encodeVarint(record + length, a);
+      if (op == delta::add_arc || op == delta::remove_arc)
+        length += encodeVarint(record + length, b);
+      journalAppend(record, length);
+  }
+
+  /**
+   @brief Accoda record e nodi al journal, tutto o niente
+
+    Le mutazioni la chiamano prima di modificare il grafo: se lancia,
+    né il grafo né il journal sono cambiati.
+
+    */
+  void journalAppend(const unsigned char *records, std::size_t count,
+                     const value_type *nodes = nullptr, std::size_t node_count = 0) {
+      if (!_journaling || (count == 0 && node_count == 0))
+        return;
+      const std::size_t old_records = _journal._records.size();
+      const std::size_t old_nodes = _journal._nodes.size();
+      try {
+        // il primo record di un journal vuoto porta l'intestazione
+        // con lo stato di partenza, che è ancora quello del grafo
+        if (old_records == 0) {
+          writeVarint(_journal._records, _size);
+          std::uint64_t base = fingerprint();
+          for (int k = 0; k < 8; ++k)
+            _journal._records.push_back(static_cast<unsigned char>(base >> (8 * k)));
+        }
+        _journal._nodes.insert(_journal._nodes.end(), nodes, nodes + node_count);
+        _journal._records.insert(_journal._records.end(), records, records + count);
+      }
+      catch (...) {
+        truncateJournal(old_records, old_nodes);
+        throw;
+      }
+  }
+
+  void truncateJournal(std::size_t records, std::size_t nodes) {
+      _journal._records.resize(records);
+      _journal._nodes.erase(_journal._nodes.begin() + nodes, _journal._nodes.end());
+  }
+
+  /**
+   @brief Impronta dello stato: numero di nodi, archi e valori dei nodi
+
+    I valori contano solo se std::hash<T> esiste (e deve essere lo
+    stesso su mittente e repliche). Costa una passata sulla matrice,
+    come una copia del grafo.
+
+    */
+  std::uint64_t fingerprint() const {
+      std::uint64_t h = mixHash(0, _size);
+      if constexpr (amgraph_is_hashable<T>::value) {
+        std::hash<T> hasher;
+        for (size_type i = 0; i < _size; ++i)
+          h = mixHash(h, hasher(_vertices[i]));
+      }
+      if constexpr (Directed) {
+        for (size_type i = 0; i < _size; ++i)
+          h = hashBytes(h, _adjacencyMatrix[i], _size);
+      }
+      else if (_size > 0) {
+        h = hashBytes(h, _halfMatrix, halfBytes(_size));
+      }
+      return h;
+  }
+
+  static std::uint64_t mixHash(std::uint64_t h, std::uint64_t value) {
+      h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+      return h * 0xff51afd7ed558ccdull;
+  }
+
+  static std::uint64_t hashBytes(std::uint64_t h, const void *data, std::size_t n) {
+      const unsigned char *bytes = static_cast<const unsigned char *>(data);
+      std::size_t k = 0;
+      for (; k + 8 <= n; k += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + k, 8);
+        h = mixHash(h, word);
+      }
+      std::uint64_t tail = 0;
+      std::memcpy(&tail, bytes + k, n - k);
+      return mixHash(h, tail ^ (n - k));
+  }
+
+  static const std::size_t max_varint = 5; ///< byte di un size_type a 32 bit
+
+  static std::size_t encodeVarint(unsigned char *out, size_type value) {
+      std::size_t length = 0;
+      while (value >= 0x80) {
+        out[length++] = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+      }
+      out[length++] = static_cast<unsigned char>(value);
+      return length;
+  }
+
+  static void writeVarint(std::vector<unsigned char> &out, size_type value) {
+      unsigned char bytes[max_varint];
+      out.insert(out.end(), bytes, bytes + encodeVarint(bytes, value));
+  }
+
+  static size_type readVarint(const unsigned char *&p, const unsigned char *end) {
+      size_type value = 0;
+      for (unsigned shift = 0; shift < 32; shift += 7) {
+        if (p == end)
+          throw std::invalid_argument("apply_delta: record troncato");
+        unsigned char byte = *p++;
+        value |= static_cast<size_type>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+          return value;
+      }
+      throw std::invalid_argument("apply_delta: varint non valido");
+  }
+
+  /**
+   @brief Aggiunge un arco tra due indici
+
+    @param src indice source
+    @param desr indice destinazione
+
+    @post _adjacenceMatrix[src][dest] == true;
+    */
+
+  void addEdge(int src, int dest) {
+      if constexpr (Directed)
+        _adjacencyMatrix[src][dest] = true;
+      else
+        setBit(_halfMatrix, halfBit(src, dest));
+  }
+
+  /**
+   @brief Rimuove un arco tra due indici
+
+    @param src indice source
+    @param desr indice destinazione
+
+    @post _adjacenceMatrix[src][dest] == false;
+    */
+  void removeEdge(int src, int dest) {
+      if constexpr (Directed)
+        _adjacencyMatrix[src][dest] = false;
+      else
+        clearBit(_halfMatrix, halfBit(src, dest));
+  }
+  
+  /**
+   @brief const function: check arco tra due indici
+
+    @param src indice source
+    @param desr indice destinazione
+
+    */
+  bool hasEdge(int src, int dest) const{
+      if constexpr (Directed)
+        return _adjacencyMatrix[src][dest];
+      else
+        return testBit(_halfMatrix, halfBit(src, dest));
+  }
+
+  /**
+   @brief halfBit: posizione di (i, j) nel triangolo superiore
+
+    Il triangolo (diagonale inclusa) è impacchettato per colonne:
+    la colonna j occupa i bit [j*(j+1)/2, j*(j+1)/2 + j].
+    L'ordine di i e j non conta.
+
+    @param i indice del primo nodo
+    @param j indice del secondo nodo
+
+    */
+  static std::size_t halfBit(int i, int j) {
+      if (i > j)
+        std::swap(i, j);
+      return static_cast<std::size_t>(j) * (j + 1) / 2 + i;
+  }
+
+  /**
+   @brief halfBytes: byte necessari al triangolo di n nodi
+
+    */
+  static std::size_t halfBytes(size_type n) {
+      return (static_cast<std::size_t>(n) * (n + 1) / 2 + 7) / 8;
+  }
+
+  static bool testBit(const unsigned char *bits, std::size_t pos) {
+      return (bits[pos >> 3] >> (pos & 7)) & 1u;
+  }
+
+  static void setBit(unsigned char *bits, std::size_t pos) {
+      bits[pos >> 3] |= static_cast<unsigned char>(1u << (pos & 7));
+  }
+
+  static void clearBit(unsigned char *bits, std::size_t pos) {
+      bits[pos >> 3] &= static_cast<unsigned char>(~(1u << (pos & 7)));
+  }
+  /**
+   @brief getVertexName
+
+    ritorna nodo di tipo T indice dall'array dei nodi.
+    @param index indice
+    
+    */
+  T getVertexName(int index) const{
+      return _vertices[index];
+  }
+  /**
+   @brief getVertexIndex: Cerca Nodo 
+    
+    Dato un identificativo di un nodo restutisce l'indice al quale quel nodo appare nel vettore _vertices
+
+    @param node riferimento costante a value_type
+
+    @returns -1 se non trovato
+
+    */
+  int getVertexIndex(const value_type &node) const{
+    AMGRAPH_TIMED(lookup);
+    if constexpr (direct_index) {
+      if (_directMapped) {
+        AMGRAPH_METRIC(++_metrics.lookup.probes;)
+        return directLookup(node);
+      }
+    }
+    for(size_type i = 0; i < _size; ++i) {
+      AMGRAPH_METRIC(++_metrics.lookup.probes;)
+      if (node == _vertices[i])
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  public:
+    /**
+    @brief exists 
+    
+    Dato un identificativo di un nodo restituisce se è presente nell'array.
+
+    @see getVertexIndex
+    
+    @param node riferimento costante a value_type
+
+    @returns false se non trovato
+  */
+
+  bool exists(const value_type &node) const{
+    return (this->getVertexIndex(node) != -1);
+  }
+   /**
+    @brief connected 
+    
+    Dato due identificativi di un nodo restituisce se è presente un collegamento diretto tra i due:
+
+    Trova gli indici dei nodi e si affida a funzioni private:
+
+    @see getVertexIndex
+    @see hasEdge
+    
+    @param node1 riferimento costante a value_type
+    @param node2 riferimento costante a value_type
+
+    @returns false se non trovato
+  */
+
+
+
+  bool connected(const value_type &node1, const value_type &node2) const{
+    AMGRAPH_TIMED(connected);
+    int index1 = this->getVertexIndex(node1);
+    int index2 = this->getVertexIndex(node2);
+    if (index1 == -1 || index2 == -1){
+      throw std::invalid_argument("Connected: Nodi non esistenti, c'è un errore di logica");
+    }
+    // nel grafo non orientato l'arco è memorizzato una volta sola
+    if constexpr (!Directed)
+      return this->hasEdge(index1,index2);
+    if  (this->hasEdge(index1,index2)||
+        (this->hasEdge(index2,index1)))
+          return true;
+    return false;
   }
   
+  /**
+    @brief find su più nodi in una volta
+
+    Risolve tutte le chiavi prima di qualsiasi accesso alla matrice.
+    Senza indice diretto, se std::hash<T> esiste e il batch è grande,
+    costruisce una sola tabella hash dei nodi (O(_size + count)) invece
+    di count ricerche lineari, e la interroga in parallelo.
+
+    @param nodes array di count nodi
+    @param count numero di nodi
+    @param out array di count handle, invalido se il nodo non esiste
+  */
+  void find_batch(const value_type *nodes, std::size_t count,
+                  vertex_handle *out) const{
+    std::vector<int> index(count);
+    resolveBatch(count, [nodes](std::size_t k) -> const value_type & {
+      return nodes[k];
+    }, index.data());
+    for (std::size_t k = 0; k < count; ++k)
+      out[k] = index[k] == -1 ? vertex_handle() : vertex_handle(index[k], _generation);
+  }
+
+  /**
+    @brief exists su più nodi in una volta
+
+    @see find_batch
+
+    @param nodes array di count nodi
+    @param count numero di nodi
+    @param out array di count risultati
+  */
+  void exists_batch(const value_type *nodes, std::size_t count, bool *out) const{
+    std::vector<int> index(count);
+    resolveBatch(count, [nodes](std::size_t k) -> const value_type & {
+      return nodes[k];
+    }, index.data());
+    for (std::size_t k = 0; k < count; ++k)
+      out[k] = index[k] != -1;
+  }
+
+  /**
+    @brief connected su più coppie di handle in una volta
+
+    Le celle della matrice vengono lette con prefetch qualche coppia
+    in anticipo e, per batch grandi, le coppie sono divise tra più
+    thread.
+
+    @param queries array di count coppie
+    @param count numero di coppie
+    @param out array di count risultati
+
+    @throw std::invalid_argument se un handle non è valido per questo
+      grafo, prima di toccare out
+  */
+  void connected_batch(const std::pair<vertex_handle, vertex_handle> *queries,
+                       std::size_t count, bool *out) const{
+    for (std::size_t q = 0; q < count; ++q) {
+      requireHandle(queries[q].first);
+      requireHandle(queries[q].second);
+    }
+    parallelFor(count, 1 << 14,
+      [this, queries, out](std::size_t first, std::size_t last) {
+        const std::size_t ahead = 16;
+        for (std::size_t q = first; q < last; ++q) {
+          if (q + ahead < last) {
+            size_type a = queries[q + ahead].first.index();
+            size_type b = queries[q + ahead].second.index();
+            __builtin_prefetch(edgeAddress(a, b));
+            if constexpr (Directed)
+              __builtin_prefetch(edgeAddress(b, a));
+          }
+          size_type a = queries[q].first.index();
+          size_type b = queries[q].second.index();
+          if constexpr (Directed)
+            out[q] = _adjacencyMatrix[a][b] || _adjacencyMatrix[b][a];
+          else
+            out[q] = testBit(_halfMatrix, halfBit(a, b));
+        }
+      });
+  }
+
+  /**
+    @brief connected su più coppie di nodi in una volta
+
+    Risolve tutte le chiavi come find_batch e poi procede come
+    connected_batch sugli handle. Con l'indice diretto ogni chiave è
+    già O(1): dopo aver controllato che tutti i nodi esistano, la
+    matrice viene letta nello stesso ciclo della risoluzione, senza
+    vettori intermedi. Se un nodo non esiste lancia l'eccezione prima
+    di toccare out.
+
+    @param queries array di count coppie
+    @param count numero di coppie
+    @param out array di count risultati
+
+    @throw std::invalid_argument se un nodo non esiste
+  */
+  void connected_batch(const std::pair<value_type, value_type> *queries,
+                       std::size_t count, bool *out) const{
+    if constexpr (direct_index) {
+      if (_directMapped) {
+        for (std::size_t q = 0; q < count; ++q)
+          if (directLookup(queries[q].first) == -1 || directLookup(queries[q].second) == -1)
+            throw std::invalid_argument("Connected: Nodi non esistenti, c'è un errore di logica");
+        parallelFor(count, 1 << 14,
+          [this, queries, out](std::size_t first, std::size_t last) {
+            // indici risolti in anticipo per il prefetch, riusati
+            // quando la query viene letta
+            const std::size_t ahead = 16;
+            int ring[2 * ahead];
+            for (std::size_t q = first; q < last && q < first + ahead; ++q) {
+              ring[2 * (q % ahead)] = directLookup(queries[q].first);
+              ring[2 * (q % ahead) + 1] = directLookup(queries[q].second);
+            }
+            for (std::size_t q = first; q < last; ++q) {
+              int a = ring[2 * (q % ahead)];
+              int b = ring[2 * (q % ahead) + 1];
+              if (q + ahead < last) {
+                int c = directLookup(queries[q + ahead].first);
+                int d = directLookup(queries[q + ahead].second);
+                __builtin_prefetch(edgeAddress(c, d));
+                if constexpr (Directed)
+                  __builtin_prefetch(edgeAddress(d, c));
+                ring[2 * (q % ahead)] = c;
+                ring[2 * (q % ahead) + 1] = d;
+              }
+              if constexpr (Directed)
+                out[q] = _adjacencyMatrix[a][b] || _adjacencyMatrix[b][a];
+              else
+                out[q] = testBit(_halfMatrix, halfBit(a, b));
+            }
+          });
+        return;
+      }
+    }
+    std::vector<int> index(2 * count);
+    resolveBatch(2 * count, [queries](std::size_t k) -> const value_type & {
+      return k % 2 ? queries[k / 2].second : queries[k / 2].first;
+    }, index.data());
+    std::vector<std::pair<vertex_handle, vertex_handle> > handles(count);
+    for (std::size_t q = 0; q < count; ++q) {
+      if (index[2 * q] == -1 || index[2 * q + 1] == -1)
+        throw std::invalid_argument("Connected: Nodi non esistenti, c'è un errore di logica");
+      handles[q] = std::make_pair(vertex_handle(index[2 * q], _generation),
+                                  vertex_handle(index[2 * q + 1], _generation));
+    }
+    connected_batch(handles.data(), count, out);
+  }
+
 /**
     @brief Metodo per stampare il grafo inizialmente,
     sono solo sicuro che posso stampare la  matrice di adiacenza
@@ -717,10 +2733,10 @@ public:
   void print() const{
           if (_size == 0)
             std::cout << "Empty Graph" << std::endl;
-          for (int i = 0; i < _size; ++i) {
+          for (size_type i = 0; i < _size; ++i) {
               //std::cout << "Vertex " << getVertexName(i) << ": ";
-              for (int j = 0; j < _size; ++j) {
-                  std::cout << _adjacencyMatrix[i][j] << " ";
+              for (size_type j = 0; j < _size; ++j) {
+                  std::cout << hasEdge(i, j) << " ";
               }
               std::cout << std::endl;
           }
@@ -729,11 +2745,80 @@ public:
     return _size;
   }
 
+  /**
+    @brief Fotografia delle metriche raccolte
+
+    Vuota se non si compila con -DAMGRAPH_METRICS.
+
+    @see Amgraph_metrics
+  */
+  Amgraph_metrics metrics() const{
+  #ifdef AMGRAPH_METRICS
+    return _metrics;
+  #else
+    return Amgraph_metrics();
+  #endif
+  }
+
+  /**
+    @brief Azzera le metriche raccolte
+  */
+  void reset_metrics(){
+  #ifdef AMGRAPH_METRICS
+    _metrics.reset();
+  #endif
+  }
+
 private:
 
+  // costruisce la matrice direttamente, senza add_Node
+  template <typename, bool> friend class Amgraph_builder;
+
   value_type *_vertices; ///< Puntatore al primo vertice
   size_type _size; ///< Dimensione dell'array
-  bool** _adjacencyMatrix;
+  bool** _adjacencyMatrix; ///< Matrice completa (solo Directed)
+  unsigned char* _halfMatrix; ///< Triangolo superiore a bit (solo !Directed)
+  delta _journal; ///< Mutazioni registrate
+  bool _journaling; ///< true se il journal è attivo
+  std::vector<int> _direct; ///< Indice diretto valore -> indice (tipi interi)
+  typename std::conditional<direct_index, T, char>::type _offset; ///< Valore di _direct[0]
+  bool _directMapped; ///< false se i nodi sono troppo sparsi per _direct
+  size_type _generation; ///< Cambia quando gli indici cambiano significato
+#ifdef AMGRAPH_METRICS
+  mutable Amgraph_metrics _metrics; ///< Metriche, anche per metodi const
+#endif
 
 };
+
+/**
+  @brief Visita in ampiezza
+
+  Funziona su Amgraph e su Amgraph::subgraph_view: richiede solo
+  getSize, contains e neighbors. Visita i nodi raggiungibili da start
+  in ordine di distanza.
+
+  @param graph grafo o vista da visitare
+  @param start nodo di partenza
+  @param visit funzione chiamata con l'handle di ogni nodo raggiunto
+
+  @pre graph.contains(start)
+*/
+template <typename Graph, typename Visitor>
+void breadth_first(const Graph &graph, typename Graph::vertex_handle start,
+                   Visitor visit) {
+  assert(graph.contains(start));
+  std::vector<bool> visited(graph.getSize(), false);
+  std::vector<typename Graph::vertex_handle> queue;
+  queue.push_back(start);
+  visited[start.index()] = true;
+  for (std::size_t head = 0; head < queue.size(); ++head) {
+    typename Graph::vertex_handle v = queue[head];
+    visit(v);
+    for (typename Graph::vertex_handle w : graph.neighbors(v))
+      if (!visited[w.index()]) {
+        visited[w.index()] = true;
+        queue.push_back(w);
+      }
+  }
+}
 #endif
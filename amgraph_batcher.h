@@ -0,0 +1,188 @@
+#ifndef AMGRAPH_BATCHER_H
+#define AMGRAPH_BATCHER_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <memory>
+#include "amgraph.h"
+
+/**
+  @file amgraph_batcher.h
+  @brief Interrogazioni concorrenti di un Amgraph raccolte in batch
+*/
+
+/**
+  @brief Classe Amgraph_batcher
+
+  Raccoglie le richieste connected/exists di più thread e le esegue
+  insieme con find_batch e connected_batch. Ogni richiesta restituisce
+  subito un std::future.
+
+  Un thread di servizio, avviato dal costruttore, prende in blocco le
+  richieste accodate, le esegue e ricomincia; i chiamanti accodano e
+  tornano subito. Più il carico è alto, più i batch sono grandi.
+  Il thread dedicato evita che un chiamante resti a svuotare la coda
+  sotto carico continuo: ogni chiamata costa solo l'accodamento e una
+  richiesta attende al più il batch in corso più il proprio.
+
+  Il distruttore esegue le richieste ancora in coda prima di fermare
+  il thread.
+
+  Il grafo non deve essere modificato finché ci sono richieste in
+  sospeso.
+
+  @see Amgraph::connected_batch
+*/
+template <typename T, bool Directed = true>
+class Amgraph_batcher {
+
+  struct request {
+    T first;
+    T second;
+    bool pair; ///< true per connected, false per exists
+    std::promise<bool> result;
+  };
+
+public:
+
+  typedef T value_type;
+  typedef Amgraph<T, Directed> graph_type;
+
+  explicit Amgraph_batcher(const graph_type &graph)
+    : _graph(graph), _stop(false) {
+    _worker = std::thread([this]() { drain(); });
+  }
+
+  Amgraph_batcher(const Amgraph_batcher &other) = delete;
+  Amgraph_batcher &operator=(const Amgraph_batcher &other) = delete;
+
+  ~Amgraph_batcher() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_one();
+    _worker.join();
+  }
+
+  /**
+    @brief Accoda connected(node1, node2)
+
+    @return future con il risultato; contiene std::invalid_argument se
+      uno dei nodi non esiste
+  */
+  std::future<bool> connected(const value_type &node1, const value_type &node2) {
+    return submit(node1, node2, true);
+  }
+
+  /**
+    @brief Accoda exists(node)
+  */
+  std::future<bool> exists(const value_type &node) {
+    return submit(node, node, false);
+  }
+
+private:
+
+  const graph_type &_graph;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::vector<request> _pending;
+  bool _stop; ///< true quando il distruttore chiede di terminare
+  std::thread _worker;
+
+  std::future<bool> submit(const value_type &node1, const value_type &node2,
+                           bool pair) {
+    std::future<bool> f;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending.push_back(request());
+      request &r = _pending.back();
+      r.first = node1;
+      r.second = node2;
+      r.pair = pair;
+      f = r.result.get_future();
+    }
+    _wake.notify_one();
+    return f;
+  }
+
+  /**
+    @brief Ciclo del thread di servizio: un batch per risveglio
+  */
+  void drain() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+      _wake.wait(lock, [this]() { return _stop || !_pending.empty(); });
+      if (_pending.empty())
+        return;
+      std::vector<request> batch;
+      batch.swap(_pending);
+      lock.unlock();
+      run(batch);
+      lock.lock();
+    }
+  }
+
+  /**
+    @brief true se entrambi i nodi di una richiesta connected esistono
+  */
+  template <typename Handle>
+  static bool resolved(const std::vector<Handle> &found, std::size_t slot) {
+    return found[slot].valid() && found[slot + 1].valid();
+  }
+
+  /**
+    @brief Esegue un batch e completa tutte le sue promise
+  */
+  void run(std::vector<request> &batch) {
+    typedef typename graph_type::vertex_handle handle;
+    const std::size_t count = batch.size();
+    // slot[k]: posizione in keys del primo nodo della richiesta k
+    std::vector<std::size_t> slot(count);
+    std::vector<handle> found;
+    std::vector<bool> answers(count, false);
+    try {
+      std::vector<value_type> keys;
+      for (std::size_t k = 0; k < count; ++k) {
+        slot[k] = keys.size();
+        keys.push_back(batch[k].first);
+        if (batch[k].pair)
+          keys.push_back(batch[k].second);
+      }
+      found.resize(keys.size());
+      _graph.find_batch(keys.data(), keys.size(), found.data());
+
+      std::vector<std::pair<handle, handle> > queries;
+      std::vector<std::size_t> owner;
+      for (std::size_t k = 0; k < count; ++k)
+        if (batch[k].pair && resolved(found, slot[k])) {
+          queries.push_back(std::make_pair(found[slot[k]], found[slot[k] + 1]));
+          owner.push_back(k);
+        }
+      std::unique_ptr<bool[]> out(new bool[queries.size() + 1]);
+      _graph.connected_batch(queries.data(), queries.size(), out.get());
+      for (std::size_t q = 0; q < queries.size(); ++q)
+        answers[owner[q]] = out[q];
+    }
+    catch (...) {
+      for (std::size_t k = 0; k < count; ++k)
+        batch[k].result.set_exception(std::current_exception());
+      return;
+    }
+
+    for (std::size_t k = 0; k < count; ++k) {
+      if (!batch[k].pair)
+        batch[k].result.set_value(found[slot[k]].valid());
+      else if (resolved(found, slot[k]))
+        batch[k].result.set_value(answers[k]);
+      else
+        batch[k].result.set_exception(std::make_exception_ptr(std::invalid_argument(
+          "Connected: Nodi non esistenti, c'è un errore di logica")));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef AMGRAPH_BUILDER_H
+#define AMGRAPH_BUILDER_H
+
+#include <mutex>
+#include <memory>
+#include "amgraph.h"
+
+/**
+  @file amgraph_builder.h
+  @brief Costruzione di un Amgraph da più thread produttori
+*/
+
+/**
+  @brief Classe Amgraph_builder
+
+  Raccoglie nodi e archi da più thread senza lock sul percorso caldo:
+  ogni thread ottiene un producer con il proprio buffer e vi accoda
+  le operazioni. finalize() costruisce poi l'Amgraph in blocco:
+    1. deduplica dei nodi partizionando per hash (un thread per
+       partizione), l'ordine finale è quello della prima occorrenza
+       scorrendo i producer nell'ordine di creazione
+    2. una sola passata di allocazione con la dimensione finale,
+       invece delle _size riallocazioni di add_Node
+    3. risoluzione degli archi e riempimento delle righe in parallelo:
+       gli archi vengono distribuiti una volta sola per blocco di righe
+       (o di byte) con un ordinamento per conteggio, e ogni thread
+       scorre solo gli archi dei blocchi che possiede
+
+  Ogni fase fa O(E / thread) lavoro per thread, quindi il tempo scala
+  con i core disponibili.
+
+  Se std::hash<T> non esiste la deduplica usa operator==, come
+  Amgraph, ed è seriale.
+
+  I producer non devono essere usati durante finalize().
+
+  @see Amgraph
+*/
+template <typename T, bool Directed = true>
+class Amgraph_builder {
+
+  struct buffer {
+    std::vector<T> nodes;
+    std::vector<std::pair<T, T> > arcs;
+  };
+
+public:
+
+  typedef T value_type;
+  typedef Amgraph<T, Directed> graph_type;
+  typedef typename graph_type::size_type size_type;
+
+  /**
+    @brief Buffer di un singolo thread produttore
+
+    Non è thread-safe: ogni thread usa il proprio.
+  */
+  class producer {
+  public:
+    producer() : _buffer(nullptr) { }
+
+    /**
+      @brief Accoda un nodo (i duplicati vengono scartati in finalize)
+    */
+    void add_Node(const value_type &node) {
+      _buffer->nodes.push_back(node);
+    }
+
+    /**
+      @brief Accoda l'arco node1 -> node2
+
+      I due nodi possono essere aggiunti anche da altri producer;
+      devono esistere al momento di finalize.
+    */
+    void add_Arc(const value_type &node1, const value_type &node2) {
+      _buffer->arcs.push_back(std::make_pair(node1, node2));
+    }
+
+  private:
+    buffer *_buffer;
+
+    friend class Amgraph_builder;
+
+    explicit producer(buffer *b) : _buffer(b) { }
+  }; // fine della classe producer
+
+  Amgraph_builder() { }
+
+  /**
+    @brief Crea un nuovo producer (thread-safe)
+  */
+  producer make_producer() {
+    std::unique_ptr<buffer> b(new buffer);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _buffers.push_back(std::move(b));
+    return producer(_buffers.back().get());
+  }
+
+  /**
+    @brief Svuota tutti i buffer, i producer esistenti restano validi
+  */
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (std::size_t b = 0; b < _buffers.size(); ++b) {
+      _buffers[b]->nodes.clear();
+      _buffers[b]->arcs.clear();
+    }
+  }
+
+  /**
+    @brief Costruisce il grafo con i dati raccolti
+
+    Il contenuto di out viene sostituito; il suo journal non registra
+    la costruzione. Se viene lanciata un'eccezione out non cambia.
+
+    @param out grafo di destinazione
+
+    @throw std::invalid_argument se un arco usa un nodo mai aggiunto
+  */
+  void finalize(graph_type &out) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<const T *> flat;
+    for (std::size_t b = 0; b < _buffers.size(); ++b)
+      for (std::size_t k = 0; k < _buffers[b]->nodes.size(); ++k)
+        flat.push_back(&_buffers[b]->nodes[k]);
+
+    std::vector<const std::pair<T, T> *> arcs;
+    for (std::size_t b = 0; b < _buffers.size(); ++b)
+      for (std::size_t k = 0; k < _buffers[b]->arcs.size(); ++k)
+        arcs.push_back(&_buffers[b]->arcs[k]);
+
+    // dedup: reps sono le posizioni in flat delle prime occorrenze,
+    // ends[a] gli indici finali degli estremi dell'arco a
+    std::vector<std::size_t> reps;
+    std::vector<std::pair<size_type, size_type> > ends(arcs.size());
+    resolve(flat, arcs, reps, ends, amgraph_is_hashable<T>());
+
+    const size_type n = static_cast<size_type>(reps.size());
+    graph_type tmp;
+    tmp._vertices = new value_type[n];
+    if constexpr (Directed)
+      tmp._adjacencyMatrix = new bool*[n]();
+    else
+      tmp._halfMatrix = new unsigned char[graph_type::halfBytes(n)]();
+    tmp._size = n;
+
+    for (size_type i = 0; i < n; ++i)
+      tmp._vertices[i] = *flat[reps[i]];
+
+    std::vector<std::pair<size_type, size_type> > sorted;
+    std::vector<std::size_t> start;
+    if constexpr (Directed) {
+      // blocchi di row_block righe: ogni thread alloca e riempie le
+      // righe dei propri blocchi (le righe non ancora allocate sono
+      // nullptr e il distruttore di tmp le ignora)
+      const std::size_t blocks = (n + row_block - 1) / row_block;
+      bucketize(ends, blocks,
+        [](const std::pair<size_type, size_type> &e) {
+          return e.first / row_block;
+        }, sorted, start);
+      bool **rows = tmp._adjacencyMatrix;
+      graph_type::parallelFor(blocks, 1,
+        [rows, n, &sorted, &start](std::size_t b0, std::size_t b1) {
+          for (std::size_t i = b0 * row_block; i < n && i < b1 * row_block; ++i)
+            rows[i] = new bool[n]();
+          for (std::size_t a = start[b0]; a < start[b1]; ++a)
+            rows[sorted[a].first][sorted[a].second] = true;
+        });
+    }
+    else {
+      // blocchi di byte_block byte della matrice triangolare
+      const std::size_t blocks = (graph_type::halfBytes(n) + byte_block - 1) / byte_block;
+      bucketize(ends, blocks,
+        [](const std::pair<size_type, size_type> &e) {
+          return graph_type::halfBit(e.first, e.second) / 8 / byte_block;
+        }, sorted, start);
+      unsigned char *bits = tmp._halfMatrix;
+      graph_type::parallelFor(blocks, 1,
+        [bits, &sorted, &start](std::size_t b0, std::size_t b1) {
+          for (std::size_t a = start[b0]; a < start[b1]; ++a)
+            graph_type::setBit(bits, graph_type::halfBit(sorted[a].first, sorted[a].second));
+        });
+    }
+
+    tmp.rebuildIndex();
+    out.swapStorage(tmp);
+  }
+
+private:
+
+  static const std::size_t row_block = 256;     ///< righe per blocco
+  static const std::size_t byte_block = 1 << 16; ///< byte per blocco
+
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<buffer> > _buffers;
+
+  /**
+    @brief Numero di thread disponibili, almeno 1
+  */
+  static std::size_t threads() {
+    std::size_t count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+  }
+
+  /**
+    @brief Ordinamento per conteggio di items in buckets secchi
+
+    key(x) < buckets è il secchio dell'elemento x. Alla fine il secchio
+    b occupa out[start[b]] ... out[start[b + 1] - 1], con gli elementi
+    nell'ordine di items. Conteggio e distribuzione sono paralleli su
+    fette di items, ognuna con il proprio istogramma.
+  */
+  template <typename V, typename Key>
+  static void bucketize(const std::vector<V> &items, std::size_t buckets, Key key,
+                        std::vector<V> &out, std::vector<std::size_t> &start) {
+    const std::size_t count = items.size();
+    const std::size_t slices = std::max<std::size_t>(1, std::min(threads(), count / 4096));
+    const std::size_t chunk = (count + slices - 1) / slices;
+
+    // offset[s * buckets + b]: prima posizione della fetta s nel secchio b
+    std::vector<std::size_t> offset(slices * buckets, 0);
+    graph_type::parallelFor(slices, 1, [&](std::size_t s0, std::size_t s1) {
+      for (std::size_t s = s0; s < s1; ++s)
+        for (std::size_t k = s * chunk; k < count && k < (s + 1) * chunk; ++k)
+          ++offset[s * buckets + key(items[k])];
+    });
+
+    start.assign(buckets + 1, 0);
+    std::size_t pos = 0;
+    for (std::size_t b = 0; b < buckets; ++b) {
+      start[b] = pos;
+      for (std::size_t s = 0; s < slices; ++s) {
+        std::size_t size = offset[s * buckets + b];
+        offset[s * buckets + b] = pos;
+        pos += size;
+      }
+    }
+    start[buckets] = pos;
+
+    out.resize(count);
+    graph_type::parallelFor(slices, 1, [&](std::size_t s0, std::size_t s1) {
+      for (std::size_t s = s0; s < s1; ++s)
+        for (std::size_t k = s * chunk; k < count && k < (s + 1) * chunk; ++k)
+          out[offset[s * buckets + key(items[k])]++] = items[k];
+    });
+  }
+
+  /**
+    @brief Dedup e risoluzione archi con std::hash, partizionato
+  */
+  static void resolve(const std::vector<const T *> &flat,
+                      const std::vector<const std::pair<T, T> *> &arcs,
+                      std::vector<std::size_t> &reps,
+                      std::vector<std::pair<size_type, size_type> > &ends,
+                      std::true_type) {
+    const std::size_t count = flat.size();
+    std::vector<std::pair<std::size_t, std::size_t> > hashes(count);
+    graph_type::parallelFor(count, 4096,
+      [&](std::size_t first, std::size_t last) {
+        std::hash<T> hasher;
+        for (std::size_t k = first; k < last; ++k)
+          hashes[k] = std::make_pair(hasher(*flat[k]), k);
+      });
+
+    const std::size_t parts = threads();
+
+    // (hash, posizione) distribuiti una volta per partizione
+    std::vector<std::pair<std::size_t, std::size_t> > scattered;
+    std::vector<std::size_t> start;
+    bucketize(hashes, parts,
+      [parts](const std::pair<std::size_t, std::size_t> &h) {
+        return h.first % parts;
+      }, scattered, start);
+
+    // per partizione: (hash, posizione) ordinati, first[k] = prima
+    // occorrenza del valore flat[k]
+    std::vector<std::vector<std::pair<std::size_t, std::size_t> > > table(parts);
+    std::vector<std::size_t> first(count);
+    graph_type::parallelFor(parts, 1, [&](std::size_t p0, std::size_t p1) {
+      for (std::size_t p = p0; p < p1; ++p) {
+        std::vector<std::pair<std::size_t, std::size_t> > &part = table[p];
+        part.assign(scattered.begin() + start[p], scattered.begin() + start[p + 1]);
+        std::sort(part.begin(), part.end());
+
+        std::vector<std::pair<std::size_t, std::size_t> > kept;
+        std::size_t run = 0;
+        for (std::size_t k = 0; k < part.size(); ++k) {
+          if (k > 0 && part[k].first != part[k - 1].first)
+            run = kept.size();
+          std::size_t pos = part[k].second;
+          first[pos] = pos;
+          for (std::size_t r = run; r < kept.size(); ++r)
+            if (*flat[kept[r].second] == *flat[pos]) {
+              first[pos] = kept[r].second;
+              break;
+            }
+          if (first[pos] == pos)
+            kept.push_back(part[k]);
+        }
+        part.swap(kept);
+      }
+    });
+
+    std::vector<size_type> final_index(count);
+    for (std::size_t k = 0; k < count; ++k)
+      if (first[k] == k) {
+        final_index[k] = static_cast<size_type>(reps.size());
+        reps.push_back(k);
+      }
+
+    std::vector<char> missing(parts, 0);
+    auto lookup = [&](const T &value, bool &ok) -> size_type {
+      std::size_t h = std::hash<T>()(value);
+      const std::vector<std::pair<std::size_t, std::size_t> > &part = table[h % parts];
+      typename std::vector<std::pair<std::size_t, std::size_t> >::const_iterator it =
+        std::lower_bound(part.begin(), part.end(), std::make_pair(h, std::size_t(0)));
+      for (; it != part.end() && it->first == h; ++it)
+        if (*flat[it->second] == value)
+          return final_index[it->second];
+      ok = false;
+      return 0;
+    };
+    std::size_t chunk = (arcs.size() + parts - 1) / parts;
+    graph_type::parallelFor(parts, 1, [&](std::size_t p0, std::size_t p1) {
+      for (std::size_t p = p0; p < p1; ++p) {
+        bool ok = true;
+        for (std::size_t a = p * chunk; a < arcs.size() && a < (p + 1) * chunk; ++a) {
+          ends[a].first = lookup(arcs[a]->first, ok);
+          ends[a].second = lookup(arcs[a]->second, ok);
+        }
+        missing[p] = !ok;
+      }
+    });
+    for (std::size_t p = 0; p < parts; ++p)
+      if (missing[p])
+        throw std::invalid_argument("Amgraph_builder: Nodi non esistenti, c'è un errore di logica");
+  }
+
+  /**
+    @brief Dedup e risoluzione archi con il solo operator==
+  */
+  static void resolve(const std::vector<const T *> &flat,
+                      const std::vector<const std::pair<T, T> *> &arcs,
+                      std::vector<std::size_t> &reps,
+                      std::vector<std::pair<size_type, size_type> > &ends,
+                      std::false_type) {
+    auto find = [&](const T &value) -> std::size_t {
+      for (std::size_t r = 0; r < reps.size(); ++r)
+        if (*flat[reps[r]] == value)
+          return r;
+      return reps.size();
+    };
+    for (std::size_t k = 0; k < flat.size(); ++k)
+      if (find(*flat[k]) == reps.size())
+        reps.push_back(k);
+    for (std::size_t a = 0; a < arcs.size(); ++a) {
+      std::size_t src = find(arcs[a]->first);
+      std::size_t dest = find(arcs[a]->second);
+      if (src == reps.size() || dest == reps.size())
+        throw std::invalid_argument("Amgraph_builder: Nodi non esistenti, c'è un errore di logica");
+      ends[a] = std::make_pair(static_cast<size_type>(src),
+                               static_cast<size_type>(dest));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef AMGRAPH_HANDLE_H
+#define AMGRAPH_HANDLE_H
+
+#include <atomic>
+
+/**
+  @file amgraph_handle.h
+  @brief Handle di vertice e range dei vicini comuni ai grafi della libreria
+*/
+
+template <typename T, bool Directed> class Amgraph;
+template <typename T> class DiskAmgraph;
+template <typename T> class CompressedAmgraph;
+
+/**
+  @brief Nuova generazione, unica tra tutti i grafi del programma
+
+  Un grafo prende una generazione nuova quando nasce e ogni volta che
+  i suoi indici cambiano significato (rimozione di nodi, permutazioni,
+  sostituzione del contenuto).
+*/
+inline unsigned int amgraph_next_generation() {
+  static std::atomic<unsigned int> counter(0);
+  return ++counter;
+}
+
+/**
+  @brief Handle tipizzato di un vertice
+
+  Contiene l'indice del nodo e la generazione del grafo nel momento
+  in cui l'handle è stato creato. Finché il grafo non sposta i suoi
+  indici (add_Node, add_Arc e remove_Arc non lo fanno) l'handle resta
+  valido; dopo remove_Node, permute, reorder o apply_delta la
+  generazione del grafo cambia e l'handle viene rifiutato con
+  std::invalid_argument invece di riferirsi in silenzio a un altro
+  nodo. graph.contains(h) dice se h è ancora valido per graph.
+
+  La generazione segue il contenuto: una copia del grafo accetta gli
+  handle dell'originale finché nessuno dei due sposta gli indici.
+*/
+class amgraph_vertex_handle {
+public:
+  typedef unsigned int size_type;
+
+  /**
+    @brief Costruttore di default: handle nullo
+  */
+  amgraph_vertex_handle() : _index(npos), _generation(0) { }
+
+  /**
+    @brief Indice del vertice nel grafo
+  */
+  size_type index() const {
+    return _index;
+  }
+
+  /**
+    @brief Generazione del grafo al momento della creazione
+  */
+  size_type generation() const {
+    return _generation;
+  }
+
+  /**
+    @brief true se l'handle non è nullo
+
+    Non dice se il grafo ha spostato gli indici nel frattempo: per
+    quello si usa contains(h) sul grafo.
+  */
+  bool valid() const {
+    return _index != npos;
+  }
+
+  bool operator==(const amgraph_vertex_handle &other) const {
+    return _index == other._index && _generation == other._generation;
+  }
+
+  bool operator!=(const amgraph_vertex_handle &other) const {
+    return !(*this == other);
+  }
+
+private:
+  static const size_type npos = static_cast<size_type>(-1);
+
+  size_type _index;
+  size_type _generation;
+
+  template <typename, bool> friend class Amgraph;
+  template <typename> friend class DiskAmgraph;
+  template <typename> friend class CompressedAmgraph;
+
+  amgraph_vertex_handle(size_type index, size_type generation)
+    : _index(index), _generation(generation) { }
+}; // fine della classe amgraph_vertex_handle
+
+/**
+  @brief Coppia di iteratori sui vicini, utilizzabile nei range-for
+
+  È il tipo restituito da neighbors() nei grafi della libreria, con
+  l'iteratore di vicini di ciascun grafo.
+*/
+template <typename Iterator>
+class amgraph_range {
+public:
+  typedef Iterator iterator;
+
+  amgraph_range(const Iterator &b, const Iterator &e)
+    : _begin(b), _end(e) { }
+
+  Iterator begin() const {
+    return _begin;
+  }
+
+  Iterator end() const {
+    return _end;
+  }
+
+private:
+  Iterator _begin;
+  Iterator _end;
+}; // fine della classe amgraph_range
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef AMGRAPH_METRICS_H
+#define AMGRAPH_METRICS_H
+
+#include <ostream> // std::ostream
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+
+/**
+  @file amgraph_metrics.h
+  @brief Metriche di Amgraph: contatori e istogrammi di latenza
+
+  Le metriche vengono raccolte solo se si compila con
+  -DAMGRAPH_METRICS, altrimenti Amgraph non contiene né i contatori
+  né le chiamate a clock e metrics() restituisce una fotografia vuota.
+
+  Anche i metodi const (connected, getVertexIndex) aggiornano le
+  metriche, per cui tutti i contatori sono atomici con ordinamento
+  relaxed: più thread possono leggere lo stesso grafo, ad esempio
+  Amgraph_batcher insieme a chiamate dirette. Ogni contatore è
+  esatto, ma una fotografia presa durante le chiamate può mescolare
+  campioni di istanti vicini (count() e i bucket possono differire
+  di qualche unità).
+*/
+
+/**
+  @brief Contatore atomico copiabile
+
+  Incrementi e letture relaxed: serve solo a contare, non a ordinare
+  altri accessi. La copia legge il valore corrente.
+*/
+class relaxed_counter {
+public:
+  relaxed_counter(std::uint64_t value = 0) : _value(value) { }
+
+  relaxed_counter(const relaxed_counter &other) : _value(other.load()) { }
+
+  relaxed_counter &operator=(const relaxed_counter &other) {
+    store(other.load());
+    return *this;
+  }
+
+  relaxed_counter &operator=(std::uint64_t value) {
+    store(value);
+    return *this;
+  }
+
+  relaxed_counter &operator++() {
+    _value.fetch_add(1, std::memory_order_relaxed);
+    return *this;
+  }
+
+  operator std::uint64_t() const {
+    return load();
+  }
+
+  std::uint64_t load() const {
+    return _value.load(std::memory_order_relaxed);
+  }
+
+  void store(std::uint64_t value) {
+    _value.store(value, std::memory_order_relaxed);
+  }
+
+  /**
+    @brief Porta il valore a value se è minore
+  */
+  void lower_to(std::uint64_t value) {
+    std::uint64_t current = load();
+    while (value < current &&
+           !_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+  }
+
+  /**
+    @brief Porta il valore a value se è maggiore
+  */
+  void raise_to(std::uint64_t value) {
+    std::uint64_t current = load();
+    while (value > current &&
+           !_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+  }
+
+private:
+  std::atomic<std::uint64_t> _value;
+};
+
+/**
+  @brief Istogramma di latenza in stile HDR
+
+  Bucket log-lineari: valori da 0 a 15 ns hanno un bucket ciascuno,
+  poi ogni potenza di 2 è divisa in 8 sotto-bucket, per un errore
+  relativo massimo di 1/8. I valori oltre 2^40 ns finiscono nell'ultimo
+  bucket.
+*/
+class latency_histogram {
+public:
+  static const unsigned buckets = 16 + 37 * 8;
+
+  latency_histogram() {
+    reset();
+  }
+
+  /**
+    @brief Registra un campione
+
+    @param ns durata in nanosecondi
+  */
+  void record(std::uint64_t ns) {
+    ++_counts[bucket(ns)];
+    ++_total;
+    _min.lower_to(ns);
+    _max.raise_to(ns);
+  }
+
+  void reset() {
+    for (unsigned i = 0; i < buckets; ++i)
+      _counts[i] = 0;
+    _total = 0;
+    _min = UINT64_MAX;
+    _max = 0;
+  }
+
+  std::uint64_t count() const {
+    return _total;
+  }
+
+  std::uint64_t min() const {
+    return _total ? _min.load() : 0;
+  }
+
+  std::uint64_t max() const {
+    return _max;
+  }
+
+  /**
+    @brief Percentile approssimato
+
+    @param q quantile in [0, 1]
+
+    @return limite superiore del bucket che contiene il quantile,
+      limitato al massimo osservato
+  */
+  std::uint64_t percentile(double q) const {
+    const std::uint64_t total = _total;
+    const std::uint64_t max = _max;
+    if (total == 0)
+      return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(q * total);
+    if (rank >= total)
+      rank = total - 1;
+    std::uint64_t seen = 0;
+    for (unsigned i = 0; i < buckets; ++i) {
+      seen += _counts[i];
+      if (seen > rank) {
+        std::uint64_t high = upper(i);
+        return high < max ? high : max;
+      }
+    }
+    return max;
+  }
+
+private:
+  relaxed_counter _counts[buckets];
+  relaxed_counter _total;
+  relaxed_counter _min;
+  relaxed_counter _max;
+
+  static unsigned bucket(std::uint64_t v) {
+    if (v < 16)
+      return static_cast<unsigned>(v);
+    unsigned msb = 63 - __builtin_clzll(v);
+    if (msb > 40)
+      return buckets - 1;
+    unsigned shift = msb - 3;
+    return 16 + (shift - 1) * 8 + static_cast<unsigned>((v >> shift) - 8);
+  }
+
+  static std::uint64_t upper(unsigned i) {
+    if (i < 16)
+      return i;
+    unsigned shift = (i - 16) / 8 + 1;
+    std::uint64_t top = (i - 16) % 8 + 8;
+    return ((top + 1) << shift) - 1;
+  }
+};
+
+/**
+  @brief Metriche di una singola operazione
+*/
+struct operation_metrics {
+  relaxed_counter calls;  ///< numero di chiamate
+  relaxed_counter probes; ///< confronti tra value_type durante la ricerca
+  latency_histogram latency; ///< durata delle chiamate
+
+  operation_metrics() : calls(0), probes(0) { }
+
+  void reset() {
+    calls = 0;
+    probes = 0;
+    latency.reset();
+  }
+};
+
+/**
+  @brief Fotografia delle metriche di un Amgraph
+
+  Restituita da Amgraph::metrics(). Si può stampare come testo
+  (operator<<) o come JSON (print_json) per lo scraping.
+*/
+struct Amgraph_metrics {
+  operation_metrics add_node;
+  operation_metrics remove_node;
+  operation_metrics add_arc;
+  operation_metrics connected;
+  operation_metrics lookup; ///< getVertexIndex
+  relaxed_counter reallocations; ///< ricostruzioni di vertici e matrice
+
+  Amgraph_metrics() : reallocations(0) { }
+
+  void reset() {
+    add_node.reset();
+    remove_node.reset();
+    add_arc.reset();
+    connected.reset();
+    lookup.reset();
+    reallocations = 0;
+  }
+
+  /**
+    @brief Scrive le metriche in formato JSON
+
+    @param os stream di output
+  */
+  void print_json(std::ostream &os) const {
+    os << "{\"reallocations\":" << reallocations << ",\"operations\":{";
+    for (unsigned i = 0; i < count; ++i) {
+      const operation_metrics &m = operation(i);
+      os << (i ? "," : "") << '"' << name(i) << "\":{"
+         << "\"calls\":" << m.calls
+         << ",\"probes\":" << m.probes
+         << ",\"latency_ns\":{"
+         << "\"min\":" << m.latency.min()
+         << ",\"p50\":" << m.latency.percentile(0.50)
+         << ",\"p90\":" << m.latency.percentile(0.90)
+         << ",\"p99\":" << m.latency.percentile(0.99)
+         << ",\"max\":" << m.latency.max() << "}}";
+    }
+    os << "}}";
+  }
+
+  /**
+    @brief Scrive le metriche come testo, una riga per operazione
+  */
+  friend std::ostream &operator<<(std::ostream &os, const Amgraph_metrics &m) {
+    os << "reallocations " << m.reallocations << std::endl;
+    for (unsigned i = 0; i < count; ++i) {
+      const operation_metrics &op = m.operation(i);
+      os << name(i) << " calls " << op.calls
+         << " probes " << op.probes
+         << " ns min " << op.latency.min()
+         << " p50 " << op.latency.percentile(0.50)
+         << " p90 " << op.latency.percentile(0.90)
+         << " p99 " << op.latency.percentile(0.99)
+         << " max " << op.latency.max() << std::endl;
+    }
+    return os;
+  }
+
+private:
+  static const unsigned count = 5;
+
+  static const char *name(unsigned i) {
+    static const char *names[count] = {
+      "add_Node", "remove_Node", "add_Arc", "connected", "getVertexIndex"
+    };
+    return names[i];
+  }
+
+  const operation_metrics &operation(unsigned i) const {
+    const operation_metrics *ops[count] = {
+      &add_node, &remove_node, &add_arc, &connected, &lookup
+    };
+    return *ops[i];
+  }
+};
+
+/**
+  @brief Cronometro RAII: conta la chiamata e ne registra la durata
+*/
+class metrics_timer {
+public:
+  explicit metrics_timer(operation_metrics &op)
+    : _op(op), _start(std::chrono::steady_clock::now()) {
+    ++_op.calls;
+  }
+
+  ~metrics_timer() {
+    _op.latency.record(static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - _start).count()));
+  }
+
+private:
+  operation_metrics &_op;
+  std::chrono::steady_clock::time_point _start;
+
+  metrics_timer(const metrics_timer &);
+  metrics_timer &operator=(const metrics_timer &);
+};
+
+#endif
@@ -0,0 +1,181 @@
+/**
+@file bench.cpp
+@brief benchmark di attraversamento prima e dopo il riordino di Amgraph,
+di Amgraph_builder::finalize e di connected singolo contro connected_batch
+**/
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include "amgraph.h"
+#include "amgraph_builder.h"
+
+typedef Amgraph<int, false> graph_type;
+
+// griglia lato x lato con etichette inserite in ordine casuale
+graph_type make_grid(int side) {
+  std::vector<int> labels(side * side);
+  for (int i = 0; i < side * side; ++i)
+    labels[i] = i;
+  std::mt19937 rng(42);
+  std::shuffle(labels.begin(), labels.end(), rng);
+
+  graph_type graph;
+  std::vector<graph_type::vertex_handle> h(side * side);
+  for (int i = 0; i < side * side; ++i)
+    h[labels[i]] = graph.add_Node(labels[i]);
+  for (int r = 0; r < side; ++r)
+    for (int c = 0; c < side; ++c) {
+      if (c + 1 < side)
+        graph.add_Arc(h[r * side + c], h[r * side + c + 1]);
+      if (r + 1 < side)
+        graph.add_Arc(h[r * side + c], h[(r + 1) * side + c]);
+    }
+  return graph;
+}
+
+// BFS completa dal nodo 0, ritorna la somma degli indici visitati
+long bfs(const graph_type &graph) {
+  std::vector<bool> visited(graph.getSize(), false);
+  std::vector<graph_type::size_type> queue;
+  queue.push_back(0);
+  visited[0] = true;
+  long checksum = 0;
+  for (std::size_t head = 0; head < queue.size(); ++head) {
+    graph_type::vertex_handle v = graph.handle(queue[head]);
+    checksum += v.index();
+    for (graph_type::vertex_handle w : graph.neighbors(v))
+      if (!visited[w.index()]) {
+        visited[w.index()] = true;
+        queue.push_back(w.index());
+      }
+  }
+  return checksum;
+}
+
+// banda della matrice: massima distanza |i - j| tra indici collegati
+graph_type::size_type bandwidth(const graph_type &graph) {
+  graph_type::size_type band = 0;
+  for (graph_type::size_type i = 0; i < graph.getSize(); ++i)
+    for (graph_type::vertex_handle w : graph.neighbors(graph.handle(i)))
+      band = std::max(band, w.index() > i ? w.index() - i : i - w.index());
+  return band;
+}
+
+double time_bfs(const graph_type &graph, int rounds) {
+  long sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+    sink += bfs(graph);
+  auto stop = std::chrono::steady_clock::now();
+  if (sink == -1)
+    std::cout << sink;
+  return std::chrono::duration<double, std::milli>(stop - start).count() / rounds;
+}
+
+// finalize di Amgraph_builder: il tempo dovrebbe calare con i core
+template <bool Directed>
+void bench_finalize(const char *name, int nodes, int arcs) {
+  Amgraph_builder<int, Directed> builder;
+  typename Amgraph_builder<int, Directed>::producer p = builder.make_producer();
+  std::mt19937 rng(11);
+  for (int i = 0; i < nodes; ++i)
+    p.add_Node(i);
+  for (int a = 0; a < arcs; ++a)
+    p.add_Arc(static_cast<int>(rng() % nodes), static_cast<int>(rng() % nodes));
+
+  Amgraph<int, Directed> graph;
+  auto start = std::chrono::steady_clock::now();
+  builder.finalize(graph);
+  auto stop = std::chrono::steady_clock::now();
+  std::cout << "finalize " << name << ": " << nodes << " nodi, " << arcs
+            << " archi, " << std::thread::hardware_concurrency() << " thread, "
+            << std::chrono::duration<double, std::milli>(stop - start).count()
+            << " ms" << std::endl;
+}
+
+// connected uno per volta contro connected_batch su query casuali
+template <typename T>
+void bench_batch(const char *name, const std::vector<T> &nodes, std::size_t count) {
+  Amgraph_builder<T> builder;
+  typename Amgraph_builder<T>::producer p = builder.make_producer();
+  std::mt19937 rng(7);
+  for (std::size_t i = 0; i < nodes.size(); ++i)
+    p.add_Node(nodes[i]);
+  for (std::size_t i = 0; i < 8 * nodes.size(); ++i)
+    p.add_Arc(nodes[rng() % nodes.size()], nodes[rng() % nodes.size()]);
+  Amgraph<T> graph;
+  builder.finalize(graph);
+
+  std::vector<std::pair<T, T> > queries(count);
+  for (std::size_t q = 0; q < count; ++q)
+    queries[q] = std::make_pair(nodes[rng() % nodes.size()], nodes[rng() % nodes.size()]);
+
+  std::unique_ptr<bool[]> single(new bool[count]);
+  std::unique_ptr<bool[]> batch(new bool[count]);
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t q = 0; q < count; ++q)
+    single[q] = graph.connected(queries[q].first, queries[q].second);
+  auto middle = std::chrono::steady_clock::now();
+  graph.connected_batch(queries.data(), count, batch.get());
+  auto stop = std::chrono::steady_clock::now();
+
+  std::size_t hits = 0;
+  for (std::size_t q = 0; q < count; ++q) {
+    if (single[q] != batch[q])
+      std::cout << "errore alla query " << q << std::endl;
+    hits += single[q];
+  }
+  std::cout << name << ": " << nodes.size() << " nodi, " << count
+            << " query (" << hits << " vere), singole "
+            << std::chrono::duration<double, std::milli>(middle - start).count()
+            << " ms, batch "
+            << std::chrono::duration<double, std::milli>(stop - middle).count()
+            << " ms" << std::endl;
+}
+
+int main() {
+  const int side = 80;
+  const int rounds = 5;
+  graph_type base = make_grid(side);
+
+  std::cout << "griglia " << side << "x" << side << ", "
+            << base.getSize() << " nodi" << std::endl;
+  std::cout << "insertion order: banda " << bandwidth(base)
+            << ", BFS " << time_bfs(base, rounds) << " ms" << std::endl;
+
+  const graph_type::reorder_strategy strategies[] = {
+    graph_type::reverse_cuthill_mckee,
+    graph_type::degree_sort,
+    graph_type::bfs_order
+  };
+  const char *names[] = {"rcm", "degree_sort", "bfs_order"};
+
+  for (int k = 0; k < 3; ++k) {
+    graph_type graph(base);
+    auto start = std::chrono::steady_clock::now();
+    graph.reorder(strategies[k]);
+    auto stop = std::chrono::steady_clock::now();
+    std::cout << names[k] << ": riordino "
+              << std::chrono::duration<double, std::milli>(stop - start).count()
+              << " ms, banda " << bandwidth(graph)
+              << ", BFS " << time_bfs(graph, rounds) << " ms" << std::endl;
+  }
+
+  bench_finalize<true>("orientato", 20000, 4000000);
+  bench_finalize<false>("non orientato", 20000, 4000000);
+
+  std::vector<int> ints(8000);
+  std::vector<std::string> strings(2000);
+  for (std::size_t i = 0; i < ints.size(); ++i)
+    ints[i] = static_cast<int>(i);
+  for (std::size_t i = 0; i < strings.size(); ++i)
+    strings[i] = "nodo-" + std::to_string(i * 7919);
+  bench_batch("int", ints, 2000000);
+  bench_batch("std::string", strings, 50000);
+  return 0;
+}
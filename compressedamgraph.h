@@ -0,0 +1,889 @@
+#ifndef COMPRESSEDAMGRAPH_H
+#define COMPRESSEDAMGRAPH_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm> // std::lower_bound
+#include <iterator>  // std::forward_iterator_tag
+#include <stdexcept>
+#include <utility>   // std::swap
+#include <vector>
+#include "amgraph_handle.h"
+
+/**
+  @file compressedamgraph.h
+  @brief Dichiarazione delle classi hybrid_row e CompressedAmgraph
+*/
+
+/**
+  @brief Classe hybrid_row
+
+  Insieme di indici di colonna (una riga della matrice di adiacenza)
+  diviso in blocchi da 65536 colonne, come nelle roaring bitmap.
+  Ogni blocco sceglie la propria rappresentazione:
+    - array: colonne ordinate a 16 bit, fino a 4096 elementi
+    - bitmap: 1024 parole da 64 bit, oltre i 4096 elementi
+    - run: coppie (inizio, lunghezza - 1) ordinate, per intervalli pieni
+
+  Le modifiche mantengono array e bitmap; optimize() sceglie per ogni
+  blocco la rappresentazione più piccola, run compresi. Un blocco run
+  modificato torna array o bitmap.
+*/
+class hybrid_row {
+
+public:
+
+  hybrid_row() { }
+
+  /**
+    @brief Iteratore sulle colonne presenti, in ordine crescente
+
+    Scorre i blocchi nella loro rappresentazione, senza copiarli.
+  */
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::uint32_t             value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const std::uint32_t*      pointer;
+    typedef std::uint32_t             reference;
+
+    const_iterator() : _row(nullptr), _chunk(0), _pos(0), _word(0), _col(0) { }
+
+    reference operator*() const {
+      return _col;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator old(*this);
+      ++(*this);
+      return old;
+    }
+
+    const_iterator &operator++() {
+      const chunk &ch = _row->_chunks[_chunk];
+      if (ch.type == array_chunk)
+        ++_pos;
+      else if (ch.type == bitmap_chunk)
+        _word &= _word - 1;
+      else if (_word < ch.values[2 * _pos + 1])
+        ++_word;
+      else {
+        ++_pos;
+        _word = 0;
+      }
+      settle();
+      return *this;
+    }
+
+    bool operator==(const const_iterator &other) const {
+      return _chunk == other._chunk && _col == other._col;
+    }
+
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    const hybrid_row *_row;
+    std::size_t _chunk;
+    std::size_t _pos;    ///< array: valore, bitmap: parola, run: coppia
+    std::uint64_t _word; ///< bitmap: bit ancora da visitare, run: scarto
+    std::uint32_t _col;
+
+    friend class hybrid_row;
+
+    const_iterator(const hybrid_row *row, std::size_t chunk)
+      : _row(row), _chunk(chunk), _pos(0), _word(0), _col(0) {
+      enter();
+      settle();
+    }
+
+    // prima posizione del blocco _chunk
+    void enter() {
+      _pos = 0;
+      _word = 0;
+      if (_chunk < _row->_chunks.size() &&
+          _row->_chunks[_chunk].type == bitmap_chunk)
+        _word = _row->_chunks[_chunk].words[0];
+    }
+
+    // dalla posizione corrente al primo elemento presente, o alla fine
+    void settle() {
+      while (_chunk < _row->_chunks.size()) {
+        const chunk &ch = _row->_chunks[_chunk];
+        std::uint32_t high = static_cast<std::uint32_t>(ch.key) << 16;
+        if (ch.type == array_chunk) {
+          if (_pos < ch.values.size()) {
+            _col = high | ch.values[_pos];
+            return;
+          }
+        }
+        else if (ch.type == bitmap_chunk) {
+          while (_word == 0 && ++_pos < bitmap_words)
+            _word = ch.words[_pos];
+          if (_word != 0) {
+            _col = high | static_cast<std::uint32_t>(
+              _pos * 64 + __builtin_ctzll(_word));
+            return;
+          }
+        }
+        else if (2 * _pos < ch.values.size()) {
+          _col = high | static_cast<std::uint32_t>(ch.values[2 * _pos] + _word);
+          return;
+        }
+        ++_chunk;
+        enter();
+      }
+      _col = 0;
+    }
+  }; // fine della classe hybrid_row::const_iterator
+
+  const_iterator begin() const {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, _chunks.size());
+  }
+
+  /**
+    @brief true se la riga non ha colonne
+  */
+  bool empty() const {
+    return _chunks.empty();
+  }
+
+  /**
+    @brief Colonna più alta presente
+
+    @pre !empty()
+  */
+  std::uint32_t back() const {
+    const chunk &ch = _chunks.back();
+    std::uint32_t high = static_cast<std::uint32_t>(ch.key) << 16;
+    if (ch.type == array_chunk)
+      return high | ch.values.back();
+    if (ch.type == run_chunk)
+      return high | static_cast<std::uint32_t>(
+        ch.values[ch.values.size() - 2] + ch.values.back());
+    std::size_t w = bitmap_words;
+    while (ch.words[--w] == 0) { }
+    return high | static_cast<std::uint32_t>(w * 64 + 63 - __builtin_clzll(ch.words[w]));
+  }
+
+  /**
+    @brief true se la colonna col è presente
+  */
+  bool contains(std::uint32_t col) const {
+    std::size_t c = find(key(col));
+    if (c == _chunks.size())
+      return false;
+    const chunk &ch = _chunks[c];
+    std::uint16_t low = static_cast<std::uint16_t>(col);
+    switch (ch.type) {
+      case array_chunk:
+        return std::binary_search(ch.values.begin(), ch.values.end(), low);
+      case bitmap_chunk:
+        return (ch.words[low / 64] >> (low % 64)) & 1u;
+      default:
+        return runContains(ch, low);
+    }
+  }
+
+  /**
+    @brief Aggiunge la colonna col
+  */
+  void add(std::uint32_t col) {
+    std::uint16_t k = key(col);
+    std::size_t c = find(k);
+    if (c == _chunks.size()) {
+      chunk fresh;
+      fresh.key = k;
+      fresh.type = array_chunk;
+      fresh.cardinality = 0;
+      c = static_cast<std::size_t>(
+        std::lower_bound(_chunks.begin(), _chunks.end(), k, keyLess) - _chunks.begin());
+      _chunks.insert(_chunks.begin() + c, fresh);
+    }
+    chunk &ch = _chunks[c];
+    if (ch.type == run_chunk)
+      expand(ch);
+
+    std::uint16_t low = static_cast<std::uint16_t>(col);
+    if (ch.type == array_chunk) {
+      std::vector<std::uint16_t>::iterator it =
+        std::lower_bound(ch.values.begin(), ch.values.end(), low);
+      if (it != ch.values.end() && *it == low)
+        return;
+      ch.values.insert(it, low);
+      ++ch.cardinality;
+      if (ch.cardinality > array_max)
+        toBitmap(ch);
+    }
+    else {
+      std::uint64_t bit = std::uint64_t(1) << (low % 64);
+      if (!(ch.words[low / 64] & bit)) {
+        ch.words[low / 64] |= bit;
+        ++ch.cardinality;
+      }
+    }
+  }
+
+  /**
+    @brief Rimuove la colonna col (se presente)
+  */
+  void remove(std::uint32_t col) {
+    std::size_t c = find(key(col));
+    if (c == _chunks.size())
+      return;
+    chunk &ch = _chunks[c];
+    if (ch.type == run_chunk)
+      expand(ch);
+
+    std::uint16_t low = static_cast<std::uint16_t>(col);
+    if (ch.type == array_chunk) {
+      std::vector<std::uint16_t>::iterator it =
+        std::lower_bound(ch.values.begin(), ch.values.end(), low);
+      if (it == ch.values.end() || *it != low)
+        return;
+      ch.values.erase(it);
+      --ch.cardinality;
+    }
+    else {
+      std::uint64_t bit = std::uint64_t(1) << (low % 64);
+      if (!(ch.words[low / 64] & bit))
+        return;
+      ch.words[low / 64] &= ~bit;
+      --ch.cardinality;
+      if (ch.cardinality <= array_max)
+        toArray(ch);
+    }
+    if (ch.cardinality == 0)
+      _chunks.erase(_chunks.begin() + c);
+  }
+
+  /**
+    @brief Numero di colonne presenti
+  */
+  std::size_t cardinality() const {
+    std::size_t total = 0;
+    for (std::size_t c = 0; c < _chunks.size(); ++c)
+      total += _chunks[c].cardinality;
+    return total;
+  }
+
+  /**
+    @brief Colonne presenti, in ordine crescente
+  */
+  std::vector<std::uint32_t> columns() const {
+    std::vector<std::uint32_t> out;
+    out.reserve(cardinality());
+    for (std::size_t c = 0; c < _chunks.size(); ++c)
+      appendColumns(_chunks[c], out);
+    return out;
+  }
+
+  /**
+    @brief Numero di colonne comuni a questa riga e a other
+
+    Si confrontano solo i blocchi con la stessa chiave: array con
+    array per fusione, array con bitmap per sondaggio, bitmap con
+    bitmap per popcount dell'AND. I run vengono espansi in bitmap.
+  */
+  std::size_t intersection_count(const hybrid_row &other) const {
+    std::size_t total = 0;
+    std::size_t a = 0, b = 0;
+    while (a < _chunks.size() && b < other._chunks.size()) {
+      if (_chunks[a].key < other._chunks[b].key)
+        ++a;
+      else if (_chunks[a].key > other._chunks[b].key)
+        ++b;
+      else
+        total += intersect(_chunks[a++], other._chunks[b++]);
+    }
+    return total;
+  }
+
+  /**
+    @brief Sceglie per ogni blocco la rappresentazione più compatta
+  */
+  void optimize() {
+    for (std::size_t c = 0; c < _chunks.size(); ++c) {
+      chunk &ch = _chunks[c];
+      std::vector<std::uint16_t> runs = toRuns(ch);
+      std::size_t run_bytes = runs.size() * 2;
+      std::size_t plain_bytes = ch.cardinality <= array_max
+                                ? ch.cardinality * 2 : bitmap_words * 8;
+      if (run_bytes < plain_bytes) {
+        ch.type = run_chunk;
+        ch.values.swap(runs);
+        std::vector<std::uint64_t>().swap(ch.words);
+      }
+      else if (ch.type == run_chunk) {
+        expand(ch);
+      }
+      ch.values.shrink_to_fit();
+    }
+    _chunks.shrink_to_fit();
+  }
+
+  /**
+    @brief Memoria occupata dalla riga, in byte
+  */
+  std::size_t memory_bytes() const {
+    std::size_t total = sizeof(hybrid_row) + _chunks.capacity() * sizeof(chunk);
+    for (std::size_t c = 0; c < _chunks.size(); ++c)
+      total += _chunks[c].values.capacity() * 2 + _chunks[c].words.capacity() * 8;
+    return total;
+  }
+
+  /**
+    @brief Numero di blocchi per tipo: [array, bitmap, run]
+  */
+  void chunk_types(std::size_t counts[3]) const {
+    for (std::size_t c = 0; c < _chunks.size(); ++c)
+      ++counts[_chunks[c].type];
+  }
+
+private:
+
+  enum chunk_type { array_chunk = 0, bitmap_chunk = 1, run_chunk = 2 };
+
+  static const std::size_t array_max = 4096;
+  static const std::size_t bitmap_words = 65536 / 64;
+
+  struct chunk {
+    std::uint16_t key; ///< 16 bit alti delle colonne
+    unsigned char type;
+    std::uint32_t cardinality;
+    std::vector<std::uint16_t> values; ///< array o coppie dei run
+    std::vector<std::uint64_t> words;  ///< bitmap
+  };
+
+  std::vector<chunk> _chunks; ///< ordinati per key
+
+  static std::uint16_t key(std::uint32_t col) {
+    return static_cast<std::uint16_t>(col >> 16);
+  }
+
+  static bool keyLess(const chunk &ch, std::uint16_t k) {
+    return ch.key < k;
+  }
+
+  std::size_t find(std::uint16_t k) const {
+    std::vector<chunk>::const_iterator it =
+      std::lower_bound(_chunks.begin(), _chunks.end(), k, keyLess);
+    if (it == _chunks.end() || it->key != k)
+      return _chunks.size();
+    return static_cast<std::size_t>(it - _chunks.begin());
+  }
+
+  static bool runContains(const chunk &ch, std::uint16_t low) {
+    // ultimo run con inizio <= low
+    std::size_t lo = 0, hi = ch.values.size() / 2;
+    while (lo < hi) {
+      std::size_t mid = (lo + hi) / 2;
+      if (ch.values[2 * mid] <= low)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == 0)
+      return false;
+    std::uint32_t start = ch.values[2 * (lo - 1)];
+    return low <= start + ch.values[2 * (lo - 1) + 1];
+  }
+
+  static void appendColumns(const chunk &ch, std::vector<std::uint32_t> &out) {
+    std::uint32_t high = static_cast<std::uint32_t>(ch.key) << 16;
+    switch (ch.type) {
+      case array_chunk:
+        for (std::size_t i = 0; i < ch.values.size(); ++i)
+          out.push_back(high | ch.values[i]);
+        break;
+      case bitmap_chunk:
+        for (std::size_t w = 0; w < bitmap_words; ++w)
+          for (std::uint64_t word = ch.words[w]; word; word &= word - 1)
+            out.push_back(high | static_cast<std::uint32_t>(
+              w * 64 + __builtin_ctzll(word)));
+        break;
+      default:
+        for (std::size_t r = 0; r < ch.values.size(); r += 2)
+          for (std::uint32_t v = ch.values[r];
+               v <= static_cast<std::uint32_t>(ch.values[r]) + ch.values[r + 1]; ++v)
+            out.push_back(high | v);
+    }
+  }
+
+  static void toBitmap(chunk &ch) {
+    std::vector<std::uint64_t> words(bitmap_words, 0);
+    for (std::size_t i = 0; i < ch.values.size(); ++i)
+      words[ch.values[i] / 64] |= std::uint64_t(1) << (ch.values[i] % 64);
+    ch.words.swap(words);
+    std::vector<std::uint16_t>().swap(ch.values);
+    ch.type = bitmap_chunk;
+  }
+
+  static void toArray(chunk &ch) {
+    std::vector<std::uint16_t> values;
+    values.reserve(ch.cardinality);
+    for (std::size_t w = 0; w < bitmap_words; ++w)
+      for (std::uint64_t word = ch.words[w]; word; word &= word - 1)
+        values.push_back(static_cast<std::uint16_t>(w * 64 + __builtin_ctzll(word)));
+    ch.values.swap(values);
+    std::vector<std::uint64_t>().swap(ch.words);
+    ch.type = array_chunk;
+  }
+
+  /**
+   @brief Run -> array o bitmap secondo la cardinalità
+
+    */
+  static void expand(chunk &ch) {
+    std::vector<std::uint32_t> cols;
+    appendColumns(ch, cols);
+    std::vector<std::uint16_t> values(cols.size());
+    for (std::size_t i = 0; i < cols.size(); ++i)
+      values[i] = static_cast<std::uint16_t>(cols[i]);
+    ch.values.swap(values);
+    ch.type = array_chunk;
+    if (ch.cardinality > array_max)
+      toBitmap(ch);
+  }
+
+  static std::vector<std::uint16_t> toRuns(const chunk &ch) {
+    std::vector<std::uint32_t> cols;
+    appendColumns(ch, cols);
+    std::vector<std::uint16_t> runs;
+    for (std::size_t i = 0; i < cols.size(); ) {
+      std::size_t j = i;
+      while (j + 1 < cols.size() && cols[j + 1] == cols[j] + 1)
+        ++j;
+      runs.push_back(static_cast<std::uint16_t>(cols[i]));
+      runs.push_back(static_cast<std::uint16_t>(j - i));
+      i = j + 1;
+    }
+    return runs;
+  }
+
+  static const std::uint64_t *bitmapOf(const chunk &ch,
+                                       std::vector<std::uint64_t> &scratch) {
+    if (ch.type == bitmap_chunk)
+      return ch.words.data();
+    scratch.assign(bitmap_words, 0);
+    std::vector<std::uint32_t> cols;
+    appendColumns(ch, cols);
+    for (std::size_t i = 0; i < cols.size(); ++i)
+      scratch[(cols[i] & 0xffff) / 64] |= std::uint64_t(1) << (cols[i] % 64);
+    return scratch.data();
+  }
+
+  static std::size_t intersect(const chunk &a, const chunk &b) {
+    if (a.type == array_chunk && b.type == array_chunk) {
+      std::size_t count = 0, i = 0, j = 0;
+      while (i < a.values.size() && j < b.values.size()) {
+        if (a.values[i] < b.values[j])
+          ++i;
+        else if (a.values[i] > b.values[j])
+          ++j;
+        else {
+          ++count;
+          ++i;
+          ++j;
+        }
+      }
+      return count;
+    }
+    if (a.type == array_chunk || b.type == array_chunk) {
+      const chunk &arr = a.type == array_chunk ? a : b;
+      const chunk &other = a.type == array_chunk ? b : a;
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < arr.values.size(); ++i) {
+        std::uint16_t v = arr.values[i];
+        if (other.type == bitmap_chunk ? ((other.words[v / 64] >> (v % 64)) & 1u)
+                                       : runContains(other, v))
+          ++count;
+      }
+      return count;
+    }
+    std::vector<std::uint64_t> sa, sb;
+    const std::uint64_t *wa = bitmapOf(a, sa);
+    const std::uint64_t *wb = bitmapOf(b, sb);
+    std::size_t count = 0;
+    for (std::size_t w = 0; w < bitmap_words; ++w)
+      count += static_cast<std::size_t>(__builtin_popcountll(wa[w] & wb[w]));
+    return count;
+  }
+};
+
+/**
+  @brief Classe CompressedAmgraph
+
+  Grafo orientato con una hybrid_row per nodo al posto della riga di
+  bool di Amgraph: le righe quasi vuote costano pochi byte, quelle
+  quasi piene diventano bitmap o run. Pensata per grafi con gradi
+  molto sbilanciati, dove né la matrice né le liste di adiacenza sono
+  compatte.
+
+  I nodi si cercano per confronto lineare. add_Node di un valore già
+  presente restituisce il suo handle, add_Arc, remove_Arc e connected
+  lanciano std::invalid_argument per nodi assenti e connected guarda
+  entrambe le direzioni dell'arco. remove_Node scala di uno gli indici
+  successivi e ricostruisce solo le righe che puntano oltre il nodo
+  rimosso; gli handle precedenti vengono rifiutati come in Amgraph.
+
+  neighbors() scorre direttamente i blocchi della riga (array, bitmap
+  o run) e restituisce i vicini in ordine di indice; out_degree e
+  common_successors lavorano sui blocchi senza espanderli.
+
+  @see Amgraph
+  @see hybrid_row
+*/
+template <typename T>
+class CompressedAmgraph {
+
+public:
+
+  typedef T value_type;
+  typedef unsigned int size_type;
+
+  /**
+    @brief Handle di un vertice, lo stesso di Amgraph
+
+    @see amgraph_vertex_handle
+  */
+  typedef amgraph_vertex_handle vertex_handle;
+
+  /**
+    @brief Iteratore sugli archi uscenti di un vertice
+
+    Avvolge hybrid_row::const_iterator: nessuna copia della riga.
+  */
+  class neighbor_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef vertex_handle             value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const vertex_handle*      pointer;
+    typedef vertex_handle             reference;
+
+    neighbor_iterator() : _generation(0) { }
+
+    reference operator*() const {
+      return vertex_handle(*_it, _generation);
+    }
+
+    neighbor_iterator operator++(int) {
+      neighbor_iterator old(*this);
+      ++_it;
+      return old;
+    }
+
+    neighbor_iterator &operator++() {
+      ++_it;
+      return *this;
+    }
+
+    bool operator==(const neighbor_iterator &other) const {
+      return _it == other._it;
+    }
+
+    bool operator!=(const neighbor_iterator &other) const {
+      return _it != other._it;
+    }
+
+  private:
+    hybrid_row::const_iterator _it;
+    size_type _generation;
+
+    friend class CompressedAmgraph;
+
+    neighbor_iterator(const hybrid_row::const_iterator &it, size_type generation)
+      : _it(it), _generation(generation) { }
+  }; // fine della classe neighbor_iterator
+
+  /**
+    @brief Range dei vicini, utilizzabile nei range-for
+  */
+  typedef amgraph_range<neighbor_iterator> neighbor_range;
+
+  CompressedAmgraph() : _generation(amgraph_next_generation()) { }
+
+  /**
+    @brief Costruisce la versione compressa di un grafo
+
+    @param graph grafo orientato con l'interfaccia di Amgraph
+  */
+  template <typename Graph>
+  explicit CompressedAmgraph(const Graph &graph)
+    : _generation(amgraph_next_generation()) {
+    for (size_type i = 0; i < graph.getSize(); ++i)
+      add_Node(graph[i]);
+    for (size_type i = 0; i < graph.getSize(); ++i)
+      for (typename Graph::vertex_handle h : graph.neighbors(graph.handle(i)))
+        _rows[i].add(h.index());
+    optimize();
+  }
+
+  size_type getSize() const {
+    return static_cast<size_type>(_vertices.size());
+  }
+
+  const value_type &operator[](size_type index) const {
+    assert(index < _vertices.size());
+    return _vertices[index];
+  }
+
+  typedef typename std::vector<T>::const_iterator const_iterator;
+
+  const_iterator begin() const {
+    return _vertices.begin();
+  }
+
+  const_iterator end() const {
+    return _vertices.end();
+  }
+
+  /**
+    @brief Aggiunge un nodo isolato
+
+    @return handle del nodo (quello esistente se era già presente)
+  */
+  vertex_handle add_Node(const value_type &node) {
+    int present = getVertexIndex(node);
+    if (present != -1)
+      return vertex_handle(present, _generation);
+    _rows.push_back(hybrid_row());
+    try {
+      _vertices.push_back(node);
+    }
+    catch (...) {
+      _rows.pop_back();
+      throw;
+    }
+    return vertex_handle(getSize() - 1, _generation);
+  }
+
+  /**
+    @brief Rimuove un nodo e i suoi archi
+
+    Come in Amgraph gli indici successivi scalano di uno, per cui tutte
+    le righe che puntano oltre il nodo vengono ricostruite. Le righe e
+    i nodi nuovi si preparano a parte e si scambiano solo alla fine: se
+    un'allocazione fallisce il grafo resta com'era.
+  */
+  void remove_Node(const value_type &node) {
+    int found = getVertexIndex(node);
+    if (found == -1)
+      return;
+    std::uint32_t index = static_cast<std::uint32_t>(found);
+
+    std::vector<T> vertices;
+    vertices.reserve(_vertices.size() - 1);
+    for (std::size_t i = 0; i < _vertices.size(); ++i)
+      if (i != index)
+        vertices.push_back(_vertices[i]);
+
+    std::vector<std::size_t> shifted;
+    std::vector<hybrid_row> rebuilt;
+    for (std::size_t i = 0; i < _rows.size(); ++i) {
+      if (i == index || _rows[i].empty() || _rows[i].back() < index)
+        continue;
+      hybrid_row row;
+      for (hybrid_row::const_iterator it = _rows[i].begin(); it != _rows[i].end(); ++it)
+        if (*it != index)
+          row.add(*it > index ? *it - 1 : *it);
+      row.optimize();
+      shifted.push_back(i);
+      rebuilt.push_back(hybrid_row());
+      std::swap(rebuilt.back(), row);
+    }
+
+    // da qui solo scambi e spostamenti, che non lanciano
+    for (std::size_t k = 0; k < shifted.size(); ++k)
+      std::swap(_rows[shifted[k]], rebuilt[k]);
+    _rows.erase(_rows.begin() + index);
+    _vertices.swap(vertices);
+    _generation = amgraph_next_generation();
+  }
+
+  /**
+    @brief Aggiunge l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  void add_Arc(const value_type &node1, const value_type &node2) {
+    size_type dest = indexOf(node2);
+    _rows[indexOf(node1)].add(dest);
+  }
+
+  /**
+    @throw std::invalid_argument se uno degli handle non è valido
+  */
+  void add_Arc(vertex_handle h1, vertex_handle h2) {
+    requireHandle(h1);
+    requireHandle(h2);
+    _rows[h1.index()].add(h2.index());
+  }
+
+  /**
+    @brief Rimuove l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  void remove_Arc(const value_type &node1, const value_type &node2) {
+    size_type dest = indexOf(node2);
+    _rows[indexOf(node1)].remove(dest);
+  }
+
+  bool exists(const value_type &node) const {
+    return getVertexIndex(node) != -1;
+  }
+
+  /**
+    @brief true se c'è un arco tra i due nodi, in una qualsiasi direzione
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  bool connected(const value_type &node1, const value_type &node2) const {
+    size_type a = indexOf(node1);
+    size_type b = indexOf(node2);
+    return _rows[a].contains(b) || _rows[b].contains(a);
+  }
+
+  /**
+    @throw std::invalid_argument se uno degli handle non è valido
+  */
+  bool connected(vertex_handle h1, vertex_handle h2) const {
+    requireHandle(h1);
+    requireHandle(h2);
+    return _rows[h1.index()].contains(h2.index()) ||
+           _rows[h2.index()].contains(h1.index());
+  }
+
+  vertex_handle find(const value_type &node) const {
+    int index = getVertexIndex(node);
+    return index == -1 ? vertex_handle() : vertex_handle(index, _generation);
+  }
+
+  vertex_handle handle(size_type index) const {
+    assert(index < getSize());
+    return vertex_handle(index, _generation);
+  }
+
+  /**
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  const value_type &value(vertex_handle h) const {
+    requireHandle(h);
+    return _vertices[h.index()];
+  }
+
+  /**
+    @brief true se h si riferisce a un nodo di questo grafo
+
+    Falso per gli handle nulli, di altri grafi o precedenti a un
+    remove_Node.
+  */
+  bool contains(vertex_handle h) const {
+    return h.generation() == _generation && h.index() < getSize();
+  }
+
+  /**
+    @brief Archi uscenti di un nodo, in ordine di indice
+
+    Utilizzabile da breadth_first.
+
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  neighbor_range neighbors(vertex_handle h) const {
+    requireHandle(h);
+    const hybrid_row &row = _rows[h.index()];
+    return neighbor_range(neighbor_iterator(row.begin(), _generation),
+                          neighbor_iterator(row.end(), _generation));
+  }
+
+  /**
+    @brief Numero di archi uscenti
+
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  size_type out_degree(vertex_handle h) const {
+    requireHandle(h);
+    return static_cast<size_type>(_rows[h.index()].cardinality());
+  }
+
+  /**
+    @brief Numero di successori comuni a due nodi
+
+    @throw std::invalid_argument se uno degli handle non è valido
+  */
+  size_type common_successors(vertex_handle h1, vertex_handle h2) const {
+    requireHandle(h1);
+    requireHandle(h2);
+    return static_cast<size_type>(
+      _rows[h1.index()].intersection_count(_rows[h2.index()]));
+  }
+
+  /**
+    @brief Ricompatta tutte le righe (run compresi)
+
+    @see hybrid_row::optimize
+  */
+  void optimize() {
+    for (std::size_t i = 0; i < _rows.size(); ++i)
+      _rows[i].optimize();
+  }
+
+  /**
+    @brief Memoria occupata dalla matrice, in byte
+  */
+  std::size_t memory_bytes() const {
+    std::size_t total = _rows.capacity() * sizeof(hybrid_row);
+    for (std::size_t i = 0; i < _rows.size(); ++i)
+      total += _rows[i].memory_bytes() - sizeof(hybrid_row);
+    return total;
+  }
+
+  /**
+    @brief Numero di blocchi per tipo: [array, bitmap, run]
+  */
+  void chunk_types(std::size_t counts[3]) const {
+    counts[0] = counts[1] = counts[2] = 0;
+    for (std::size_t i = 0; i < _rows.size(); ++i)
+      _rows[i].chunk_types(counts);
+  }
+
+private:
+
+  std::vector<T> _vertices;
+  std::vector<hybrid_row> _rows; ///< una riga per nodo
+  size_type _generation;         ///< cambia quando gli indici si spostano
+
+  /**
+   @brief Lancia std::invalid_argument se h non è valido per questo grafo
+
+    */
+  void requireHandle(vertex_handle h) const {
+    if (!contains(h))
+      throw std::invalid_argument("CompressedAmgraph: Handle non valido, c'è un errore di logica");
+  }
+
+  int getVertexIndex(const value_type &node) const {
+    for (size_type i = 0; i < _vertices.size(); ++i)
+      if (node == _vertices[i])
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  size_type indexOf(const value_type &node) const {
+    int index = getVertexIndex(node);
+    if (index == -1)
+      throw std::invalid_argument("CompressedAmgraph: Nodi non esistenti, c'è un errore di logica");
+    return static_cast<size_type>(index);
+  }
+};
+
+#endif
@@ -0,0 +1,630 @@
+#ifndef DISKAMGRAPH_H
+#define DISKAMGRAPH_H
+
+#include <algorithm> // std::min
+#include <cassert>
+#include <cstdint>
+#include <cstring>  // std::memset
+#include <cstddef>  // std::ptrdiff_t
+#include <iterator> // std::forward_iterator_tag
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>  // open, posix_fadvise
+#include <unistd.h> // pread, pwrite, close, unlink
+#include "amgraph_handle.h"
+
+/**
+  @file diskamgraph.h
+  @brief Dichiarazione della classe DiskAmgraph
+*/
+
+/**
+  @brief Classe DiskAmgraph
+
+  Grafo orientato con la matrice di adiacenza su file, per grafi la cui
+  matrice non sta in memoria. I nodi restano in RAM, la matrice è
+  divisa in tile a fascia di righe (tile_rows righe per tile_cols
+  colonne) salvati su un file locale; in memoria c'è solo una cache
+  LRU di tile con un budget in byte scelto alla costruzione. I tile
+  modificati vengono riscritti su file quando escono dalla cache o
+  con flush().
+
+  Le fasce sono basse e larghe perché il grafo si legge per righe:
+  la riga di un nodo occupa un tile ogni tile_cols colonne e ogni tile
+  letto contiene solo tile_rows righe, per cui neighbors() legge al
+  più tile_rows volte i bit che servono. Le operazioni per colonna
+  (remove_Node) toccano invece un tile per fascia.
+
+  I tile sono ordinati nel file per "gusci": il guscio m contiene i
+  tile della colonna di tile m e delle fasce che servono finché le
+  colonne non superano (m + 1) * tile_cols, per cui aggiungere nodi
+  accoda tile senza spostare quelli esistenti. Finché il grafo ha
+  meno di tile_cols nodi il file è la matrice riga per riga.
+
+  Quando una visita entra in un tile si chiede al kernel di leggere in
+  anticipo il tile successivo della stessa fascia (posix_fadvise), così
+  gli algoritmi che scorrono le righe (degrees, breadth_first) trovano
+  i dati già in page cache.
+
+  I nodi si cercano per confronto lineare. add_Node di un valore già
+  presente restituisce il suo handle, add_Arc, remove_Arc e connected
+  lanciano std::invalid_argument per nodi assenti e connected guarda
+  entrambe le direzioni dell'arco. remove_Node sposta l'ultimo nodo al
+  posto di quello rimosso invece di scalare tutti gli indici, per non
+  riscrivere l'intera matrice su disco; gli handle precedenti vengono
+  rifiutati come in Amgraph.
+
+  Offre l'interfaccia di traversal di Amgraph (vertex_handle, handle,
+  contains, neighbors) e si può passare a breadth_first.
+
+  La classe non è thread-safe, nemmeno in sola lettura: connected,
+  neighbors e degrees aggiornano la cache dei tile anche se sono
+  const. Chi la condivide tra thread deve serializzare gli accessi.
+
+  @see Amgraph
+*/
+template <typename T>
+class DiskAmgraph {
+
+public:
+
+  typedef T value_type;
+  typedef unsigned int size_type;
+
+  static constexpr size_type tile_rows = 8;     ///< righe di una fascia
+  static constexpr size_type tile_cols = 32768; ///< colonne di una fascia
+  static constexpr std::size_t row_words = tile_cols / 64;
+  static constexpr std::size_t tile_words = tile_rows * row_words;
+  static constexpr std::size_t tile_bytes = tile_words * 8;
+
+  /**
+    @brief Costruttore
+
+    Crea (o tronca) il file della matrice. Il file viene eliminato dal
+    distruttore.
+
+    @param path percorso del file della matrice
+    @param cache_bytes memoria massima per i tile in cache (almeno due tile)
+
+    @throw std::runtime_error se il file non si può aprire
+  */
+  explicit DiskAmgraph(const std::string &path,
+                       std::size_t cache_bytes = 64u << 20)
+    : _path(path), _fd(-1), _capacity(cache_bytes / tile_bytes),
+      _generation(amgraph_next_generation()), _file_bytes(0),
+      _hits(0), _misses(0) {
+    if (_capacity < 2)
+      _capacity = 2;
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (_fd == -1)
+      throw std::runtime_error("DiskAmgraph: impossibile aprire " + path);
+  }
+
+  /**
+    @brief Distruttore: chiude ed elimina il file della matrice
+  */
+  ~DiskAmgraph() {
+    ::close(_fd);
+    ::unlink(_path.c_str());
+  }
+
+  size_type getSize() const {
+    return static_cast<size_type>(_vertices.size());
+  }
+
+  /**
+    @brief Getter del nodo [index]
+
+    @pre index < getSize()
+  */
+  const value_type &operator[](size_type index) const {
+    assert(index < _vertices.size());
+    return _vertices[index];
+  }
+
+  typedef typename std::vector<T>::const_iterator const_iterator;
+
+  const_iterator begin() const {
+    return _vertices.begin();
+  }
+
+  const_iterator end() const {
+    return _vertices.end();
+  }
+
+  /**
+    @brief Handle di un vertice, lo stesso di Amgraph
+
+    @see amgraph_vertex_handle
+  */
+  typedef amgraph_vertex_handle vertex_handle;
+
+  /**
+    @brief Iteratore sugli archi uscenti di un vertice
+
+    Copia segment_bits bit della riga alla volta, così non dipende
+    dal fatto che il tile resti in cache durante la visita.
+  */
+  class neighbor_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef vertex_handle             value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const vertex_handle*      pointer;
+    typedef vertex_handle             reference;
+
+    neighbor_iterator() : _graph(nullptr), _row(0), _col(0), _loaded(0) { }
+
+    reference operator*() const {
+      return vertex_handle(_col, _graph->_generation);
+    }
+
+    neighbor_iterator operator++(int) {
+      neighbor_iterator old(*this);
+      ++(*this);
+      return old;
+    }
+
+    neighbor_iterator &operator++() {
+      ++_col;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const neighbor_iterator &other) const {
+      return _col == other._col;
+    }
+
+    bool operator!=(const neighbor_iterator &other) const {
+      return _col != other._col;
+    }
+
+  private:
+    static constexpr size_type segment_bits = 512;
+
+    const DiskAmgraph *_graph;
+    size_type _row;
+    size_type _col;
+    size_type _loaded; ///< primo indice dopo il segmento in _segment
+    std::uint64_t _segment[segment_bits / 64];
+
+    friend class DiskAmgraph;
+
+    neighbor_iterator(const DiskAmgraph *graph, size_type row, size_type col)
+      : _graph(graph), _row(row), _col(col), _loaded(col) {
+      skip();
+    }
+
+    void skip() {
+      const size_type n = _graph->getSize();
+      while (_col < n) {
+        if (_col >= _loaded) {
+          size_type first = _col / segment_bits * segment_bits;
+          _graph->copySegment(_row, first, _segment, segment_bits / 64);
+          _loaded = first + segment_bits;
+        }
+        size_type local = _col % segment_bits;
+        std::uint64_t word = _segment[local / 64] >> (local % 64);
+        if (word) {
+          _col += static_cast<size_type>(__builtin_ctzll(word));
+          if (_col < n)
+            return;
+          break;
+        }
+        // parola vuota: si passa alla successiva
+        _col = (_col / 64 + 1) * 64;
+      }
+      _col = n;
+    }
+  }; // fine della classe neighbor_iterator
+
+  /**
+    @brief Range dei vicini, utilizzabile nei range-for
+  */
+  typedef amgraph_range<neighbor_iterator> neighbor_range;
+
+  /**
+    @brief Aggiunge un nodo isolato
+
+    @return handle del nodo (quello esistente se era già presente)
+  */
+  vertex_handle add_Node(const value_type &node) {
+    int present = getVertexIndex(node);
+    if (present != -1)
+      return vertex_handle(present, _generation);
+    // riga e colonna del nuovo indice sono già vuote: i tile oltre la
+    // fine del file si leggono a zero e remove_Node azzera ciò che lascia
+    _vertices.push_back(node);
+    return vertex_handle(getSize() - 1, _generation);
+  }
+
+  /**
+    @brief Rimuove un nodo e i suoi archi
+
+    L'ultimo nodo prende l'indice di quello rimosso e gli handle
+    precedenti non valgono più. Se il nodo non è presente non fa nulla.
+  */
+  void remove_Node(const value_type &node) {
+    int found = getVertexIndex(node);
+    if (found == -1)
+      return;
+    size_type index = static_cast<size_type>(found);
+    size_type last = getSize() - 1;
+    if (index != last) {
+      // gli archi tra index e last spariscono con index
+      for (size_type j = 0; j < last; ++j)
+        if (j != index)
+          setEdge(index, j, hasEdge(last, j));
+      for (size_type i = 0; i < last; ++i)
+        if (i != index)
+          setEdge(i, index, hasEdge(i, last));
+      setEdge(index, index, hasEdge(last, last));
+      _vertices[index] = _vertices[last];
+    }
+    clearRowAndColumn(last);
+    _vertices.pop_back();
+    _generation = amgraph_next_generation();
+  }
+
+  /**
+    @brief Aggiunge l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  void add_Arc(const value_type &node1, const value_type &node2) {
+    setEdge(indexOf(node1), indexOf(node2), true);
+  }
+
+  /**
+    @throw std::invalid_argument se uno degli handle non è valido
+  */
+  void add_Arc(vertex_handle h1, vertex_handle h2) {
+    requireHandle(h1);
+    requireHandle(h2);
+    setEdge(h1.index(), h2.index(), true);
+  }
+
+  /**
+    @brief Rimuove l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  void remove_Arc(const value_type &node1, const value_type &node2) {
+    setEdge(indexOf(node1), indexOf(node2), false);
+  }
+
+  bool exists(const value_type &node) const {
+    return getVertexIndex(node) != -1;
+  }
+
+  /**
+    @brief true se c'è un arco tra i due nodi, in una qualsiasi direzione
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  bool connected(const value_type &node1, const value_type &node2) const {
+    size_type a = indexOf(node1);
+    size_type b = indexOf(node2);
+    return hasEdge(a, b) || hasEdge(b, a);
+  }
+
+  /**
+    @throw std::invalid_argument se uno degli handle non è valido
+  */
+  bool connected(vertex_handle h1, vertex_handle h2) const {
+    requireHandle(h1);
+    requireHandle(h2);
+    return hasEdge(h1.index(), h2.index()) || hasEdge(h2.index(), h1.index());
+  }
+
+  /**
+    @brief Handle del nodo, non valido se il nodo non esiste
+  */
+  vertex_handle find(const value_type &node) const {
+    int index = getVertexIndex(node);
+    return index == -1 ? vertex_handle() : vertex_handle(index, _generation);
+  }
+
+  vertex_handle handle(size_type index) const {
+    assert(index < getSize());
+    return vertex_handle(index, _generation);
+  }
+
+  /**
+    @throw std::invalid_argument se h non è valido per questo grafo
+  */
+  const value_type &value(vertex_handle h) const {
+    requireHandle(h);
+    return _vertices[h.index()];
+  }
+
+  /**
+    @brief true se h si riferisce a un nodo di questo grafo
+
+    Falso per gli handle nulli, di altri grafi o precedenti a un
+    remove_Node.
+  */
+  bool contains(vertex_handle h) const {
+    return h.generation() == _generation && h.index() < getSize();
+  }
+
+  /**
+    @brief Archi uscenti di un nodo
+
+    @throw std::invalid_argument se h non è valido per questo grafo
+    @see neighbor_iterator
+  */
+  neighbor_range neighbors(vertex_handle h) const {
+    requireHandle(h);
+    return neighbor_range(neighbor_iterator(this, h.index(), 0),
+                          neighbor_iterator(this, h.index(), getSize()));
+  }
+
+  /**
+    @brief Grado uscente di tutti i nodi
+
+    Scorre la matrice una fascia alla volta, chiedendo in anticipo il
+    tile successivo: ogni tile viene letto una sola volta anche con una
+    cache di due tile.
+
+    @return out[i] = numero di archi uscenti dal nodo i
+  */
+  std::vector<size_type> degrees() const {
+    const size_type n = getSize();
+    const size_type bands = (n + tile_rows - 1) / tile_rows;
+    const size_type blocks = (n + tile_cols - 1) / tile_cols;
+    std::vector<size_type> out(n, 0);
+    for (size_type tr = 0; tr < bands; ++tr)
+      for (size_type tc = 0; tc < blocks; ++tc) {
+        if (tc + 1 < blocks)
+          prefetch(tr, tc + 1);
+        else if (tr + 1 < bands)
+          prefetch(tr + 1, 0);
+        const std::uint64_t *bits = tile(tr, tc, false);
+        // oltre la colonna n - 1 i bit sono tutti a zero
+        const std::size_t words = std::min<std::size_t>(
+          row_words, (n - tc * tile_cols + 63) / 64);
+        for (size_type r = 0; r < tile_rows && tr * tile_rows + r < n; ++r)
+          for (std::size_t w = 0; w < words; ++w)
+            out[tr * tile_rows + r] += static_cast<size_type>(
+              __builtin_popcountll(bits[r * row_words + w]));
+      }
+    return out;
+  }
+
+  /**
+    @brief Scrive su file tutti i tile modificati
+  */
+  void flush() const {
+    for (typename std::list<cached_tile>::iterator it = _lru.begin();
+         it != _lru.end(); ++it)
+      writeBack(*it);
+  }
+
+  std::size_t cache_hits() const {
+    return _hits;
+  }
+
+  std::size_t cache_misses() const {
+    return _misses;
+  }
+
+private:
+
+  struct cached_tile {
+    std::size_t slot;
+    bool dirty;
+    std::vector<std::uint64_t> bits;
+  };
+
+  std::string _path;
+  int _fd;
+  std::size_t _capacity; ///< tile massimi in cache
+  size_type _generation; ///< cambia quando gli indici si spostano
+  mutable std::size_t _file_bytes; ///< lunghezza del file scritta finora
+  std::vector<T> _vertices;
+  mutable std::list<cached_tile> _lru; ///< in testa il più recente
+  mutable std::unordered_map<std::size_t,
+    typename std::list<cached_tile>::iterator> _index;
+  mutable std::size_t _hits;
+  mutable std::size_t _misses;
+
+  DiskAmgraph(const DiskAmgraph &);
+  DiskAmgraph &operator=(const DiskAmgraph &);
+
+  /**
+   @brief Posizione nel file del tile della fascia tr e della colonna
+    di tile tc, in tile
+
+    */
+  static std::size_t slotOf(size_type tr, size_type tc) {
+    // fasce per colonna di tile: la matrice resta quadrata
+    const std::size_t q = tile_cols / tile_rows;
+    std::size_t m = tr / q > tc ? tr / q : tc;
+    // guscio m: prima la colonna di tile m (fasce 0..(m + 1) q - 1),
+    // poi le colonne 0..m - 1 delle fasce m q..(m + 1) q - 1
+    std::size_t base = q * m * m;
+    if (tc == m)
+      return base + tr;
+    return base + (m + 1) * q + (tr - m * q) * m + tc;
+  }
+
+  /**
+   @brief Tile (tr, tc) in cache, caricato dal file se serve
+
+    Il puntatore resta valido fino al prossimo accesso a un altro tile.
+
+    */
+  std::uint64_t *tile(size_type tr, size_type tc, bool write) const {
+    std::size_t slot = slotOf(tr, tc);
+    typename std::unordered_map<std::size_t,
+      typename std::list<cached_tile>::iterator>::iterator found = _index.find(slot);
+    if (found != _index.end()) {
+      ++_hits;
+      _lru.splice(_lru.begin(), _lru, found->second);
+    }
+    else {
+      ++_misses;
+      std::vector<std::uint64_t> bits(tile_words);
+      readTile(slot, bits.data());
+      if (_lru.size() >= _capacity) {
+        writeBack(_lru.back());
+        _index.erase(_lru.back().slot);
+        _lru.pop_back();
+      }
+      _lru.push_front(cached_tile());
+      _lru.front().slot = slot;
+      _lru.front().dirty = false;
+      _lru.front().bits.swap(bits);
+      _index[slot] = _lru.begin();
+    }
+    if (write)
+      _lru.front().dirty = true;
+    return _lru.front().bits.data();
+  }
+
+  void readTile(std::size_t slot, std::uint64_t *bits) const {
+    char *dst = reinterpret_cast<char *>(bits);
+    std::size_t done = 0;
+    while (done < tile_bytes) {
+      ssize_t got = ::pread(_fd, dst + done, tile_bytes - done,
+                            static_cast<off_t>(slot * tile_bytes + done));
+      if (got < 0)
+        throw std::runtime_error("DiskAmgraph: errore di lettura");
+      if (got == 0)
+        break; // oltre la fine del file: tile vuoto
+      done += static_cast<std::size_t>(got);
+    }
+    std::memset(dst + done, 0, tile_bytes - done);
+  }
+
+  void writeBack(cached_tile &t) const {
+    if (!t.dirty)
+      return;
+    const char *src = reinterpret_cast<const char *>(t.bits.data());
+    std::size_t done = 0;
+    while (done < tile_bytes) {
+      ssize_t put = ::pwrite(_fd, src + done, tile_bytes - done,
+                             static_cast<off_t>(t.slot * tile_bytes + done));
+      if (put <= 0)
+        throw std::runtime_error("DiskAmgraph: errore di scrittura");
+      done += static_cast<std::size_t>(put);
+    }
+    t.dirty = false;
+    if (_file_bytes < (t.slot + 1) * tile_bytes)
+      _file_bytes = (t.slot + 1) * tile_bytes;
+  }
+
+  /**
+   @brief Chiede al kernel di leggere in anticipo un tile
+
+    */
+  void prefetch(size_type tr, size_type tc) const {
+    std::size_t slot = slotOf(tr, tc);
+    if (_index.find(slot) != _index.end())
+      return;
+#ifdef POSIX_FADV_WILLNEED
+    ::posix_fadvise(_fd, static_cast<off_t>(slot * tile_bytes),
+                    static_cast<off_t>(tile_bytes), POSIX_FADV_WILLNEED);
+#endif
+  }
+
+  /**
+   @brief Copia words parole della riga row a partire dalla colonna
+    first (multiplo di 64 * words) in segment
+
+    */
+  void copySegment(size_type row, size_type first, std::uint64_t *segment,
+                   std::size_t words) const {
+    size_type tr = row / tile_rows;
+    size_type tc = first / tile_cols;
+    // entrando in un tile si chiede in anticipo il successivo della fascia
+    if (first % tile_cols == 0 && (tc + 1) * tile_cols < getSize())
+      prefetch(tr, tc + 1);
+    const std::uint64_t *bits = tile(tr, tc, false);
+    std::memcpy(segment,
+                bits + (row % tile_rows) * row_words + (first % tile_cols) / 64,
+                words * 8);
+  }
+
+  bool hasEdge(size_type src, size_type dest) const {
+    const std::uint64_t *bits = tile(src / tile_rows, dest / tile_cols, false);
+    std::size_t pos = static_cast<std::size_t>(src % tile_rows) * tile_cols
+                      + dest % tile_cols;
+    return (bits[pos / 64] >> (pos % 64)) & 1u;
+  }
+
+  void setEdge(size_type src, size_type dest, bool value) {
+    std::uint64_t *bits = tile(src / tile_rows, dest / tile_cols, true);
+    std::size_t pos = static_cast<std::size_t>(src % tile_rows) * tile_cols
+                      + dest % tile_cols;
+    if (value)
+      bits[pos / 64] |= std::uint64_t(1) << (pos % 64);
+    else
+      bits[pos / 64] &= ~(std::uint64_t(1) << (pos % 64));
+  }
+
+  /**
+   @brief Azzera riga e colonna index
+
+    Solo i tile già presenti nel file possono contenere bit residui.
+
+    */
+  void clearRowAndColumn(size_type index) {
+    const size_type bands = (getSize() + tile_rows - 1) / tile_rows;
+    const size_type blocks = (getSize() + tile_cols - 1) / tile_cols;
+    const size_type band = index / tile_rows;
+    const size_type block = index / tile_cols;
+    const std::uint64_t mask = ~(std::uint64_t(1) << (index % 64));
+    for (size_type k = 0; k < blocks; ++k)
+      if (onDisk(band, k)) {
+        std::uint64_t *row = tile(band, k, true) + (index % tile_rows) * row_words;
+        std::memset(row, 0, row_words * 8);
+      }
+    for (size_type k = 0; k < bands; ++k)
+      if (onDisk(k, block)) {
+        std::uint64_t *bits = tile(k, block, true) + (index % tile_cols) / 64;
+        for (size_type r = 0; r < tile_rows; ++r)
+          bits[r * row_words] &= mask;
+      }
+  }
+
+  /**
+   @brief true se il tile potrebbe avere contenuto (in cache o su file)
+
+    */
+  bool onDisk(size_type tr, size_type tc) const {
+    std::size_t slot = slotOf(tr, tc);
+    if (_index.find(slot) != _index.end())
+      return true;
+    return _file_bytes > slot * tile_bytes;
+  }
+
+  /**
+   @brief Lancia std::invalid_argument se h non è valido per questo grafo
+
+    */
+  void requireHandle(vertex_handle h) const {
+    if (!contains(h))
+      throw std::invalid_argument("DiskAmgraph: Handle non valido, c'è un errore di logica");
+  }
+
+  int getVertexIndex(const value_type &node) const {
+    for (size_type i = 0; i < _vertices.size(); ++i)
+      if (node == _vertices[i])
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  size_type indexOf(const value_type &node) const {
+    int index = getVertexIndex(node);
+    if (index == -1)
+      throw std::invalid_argument("DiskAmgraph: Nodi non esistenti, c'è un errore di logica");
+    return static_cast<size_type>(index);
+  }
+};
+
+#endif
@@ -0,0 +1,287 @@
+/**
+@file faults.cpp
+@brief iniezione di guasti (allocazioni e copie che lanciano) sulle
+mutazioni di Amgraph e stress con operazioni casuali
+
+Da compilare con ASan/UBSan (make faults): ogni operazione viene
+ripetuta facendo fallire la prima, la seconda, ... allocazione o copia
+di un nodo finché non riesce. Dopo ogni fallimento il grafo e il suo
+journal devono essere identici a prima (garanzia forte); le perdite di
+memoria le segnala LeakSanitizer all'uscita.
+**/
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <vector>
+#include "amgraph.h"
+
+// evento numero fail_at (allocazione o copia di fragile) lancia
+static std::atomic<long> events(0);
+static std::atomic<long> fail_at(0);
+
+static void maybe_fail() {
+  long armed = fail_at.load();
+  if (armed != 0 && ++events == armed)
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size) {
+  maybe_fail();
+  void *p = std::malloc(size ? size : 1);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+// std::stable_sort & co. usano il new nothrow: il guasto è un nullptr
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return operator new(size);
+  }
+  catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// nodo la cui copia può lanciare
+struct fragile {
+  int id;
+  fragile() : id(0) { }
+  explicit fragile(int i) : id(i) { }
+  fragile(const fragile &other) : id(other.id) {
+    maybe_fail();
+  }
+  fragile &operator=(const fragile &other) {
+    maybe_fail();
+    id = other.id;
+    return *this;
+  }
+  bool operator==(const fragile &other) const {
+    return id == other.id;
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, const fragile &f) {
+  return os << f.id;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, long step) {
+  if (!ok) {
+    std::cout << "ERRORE: " << what << " al guasto " << step << std::endl;
+    ++failures;
+  }
+}
+
+// stato osservabile: nodi, archi uscenti, journal
+template <typename G>
+struct snapshot {
+  std::vector<int> nodes;
+  std::vector<std::vector<unsigned> > arcs;
+  std::vector<unsigned char> records;
+  std::size_t journal_nodes;
+
+  bool operator==(const snapshot &other) const {
+    return nodes == other.nodes && arcs == other.arcs &&
+           records == other.records && journal_nodes == other.journal_nodes;
+  }
+};
+
+static int key(int v) {
+  return v;
+}
+
+static int key(const fragile &v) {
+  return v.id;
+}
+
+template <typename G>
+snapshot<G> take(const G &g) {
+  snapshot<G> s;
+  for (typename G::size_type i = 0; i < g.getSize(); ++i) {
+    s.nodes.push_back(key(g[i]));
+    s.arcs.push_back(std::vector<unsigned>());
+    for (typename G::vertex_handle w : g.neighbors(g.handle(i)))
+      s.arcs.back().push_back(w.index());
+  }
+  s.records = g.journal().records();
+  s.journal_nodes = g.journal().nodes().size();
+  return s;
+}
+
+/**
+  Esegue op(g) su una copia di start facendo fallire il k-esimo evento,
+  k = 1, 2, ... finché op non termina senza eccezioni.
+*/
+template <typename G, typename Op>
+void sweep(const char *name, const G &start, Op op) {
+  long step = 1;
+  for (;; ++step) {
+    G g(start);
+    g.enable_journal();
+    g.add_Arc(g.handle(0), g.handle(1));
+    snapshot<G> before = take(g);
+
+    bool thrown = false;
+    events = 0;
+    fail_at = step;
+    try {
+      op(g);
+    }
+    catch (const std::bad_alloc &) {
+      thrown = true;
+    }
+    fail_at = 0;
+    if (!thrown)
+      break;
+    check(take(g) == before, name, step);
+  }
+  std::cout << name << ": " << step - 1 << " guasti iniettati" << std::endl;
+}
+
+template <typename G, typename V>
+void sweep_all(const char *label, const std::vector<V> &values) {
+  std::cout << "== " << label << std::endl;
+  G base;
+  for (std::size_t i = 0; i < values.size(); ++i)
+    base.add_Node(values[i]);
+  for (std::size_t i = 0; i < values.size(); ++i)
+    base.add_Arc(values[i], values[(i * 5 + 3) % values.size()]);
+
+  G other;
+  other.add_Node(values[0]);
+  other.add_Node(values[1]);
+  other.add_Arc(values[1], values[0]);
+
+  // il delta parte dallo stato che sweep passa a op
+  G source(base);
+  source.add_Arc(source.handle(0), source.handle(1));
+  source.enable_journal();
+  source.add_Node(V(2000));
+  source.add_Arc(values[0], V(2000));
+  source.remove_Node(values[5]);
+  source.add_Arc(values[1], values[7]);
+  const typename G::delta d = source.journal();
+
+  sweep("add_Node", base, [&](G &g) { g.add_Node(V(1000)); });
+  sweep("remove_Node", base, [&](G &g) { g.remove_Node(values[3]); });
+  sweep("add_Arc", base, [&](G &g) { g.add_Arc(values[2], values[8]); });
+  sweep("remove_Arc", base, [&](G &g) { g.remove_Arc(values[0], values[3]); });
+  sweep("copia", base, [&](G &g) { G copy(g); });
+  sweep("operator=", base, [&](G &g) { g = other; });
+  sweep("permute", base, [&](G &g) {
+    std::vector<typename G::size_type> perm(g.getSize());
+    for (typename G::size_type i = 0; i < g.getSize(); ++i)
+      perm[i] = g.getSize() - 1 - i;
+    g.permute(perm);
+  });
+  sweep("reorder", base, [&](G &g) { g.reorder(G::reverse_cuthill_mckee); });
+  sweep("apply_delta", base, [&](G &g) { g.apply_delta(d); });
+  sweep("complement", base, [&](G &g) { g.complement(); });
+  sweep("transpose", base, [&](G &g) { g.transpose(); });
+  sweep("induced_subgraph", base, [&](G &g) {
+    G sub = g.induced_subgraph(values.begin(), values.begin() + 5);
+  });
+  sweep("graph_union", base, [&](G &g) { G u = graph_union(g, other); });
+}
+
+// operazioni casuali con journal; alla fine il journal riapplicato a
+// una copia iniziale deve ridare lo stesso grafo
+template <typename G>
+void stress(const char *label, int operations) {
+  std::mt19937 rng(2024);
+  G g;
+  for (int i = 0; i < 64; ++i)
+    g.add_Node(i);
+  G replay(g);
+  g.enable_journal();
+
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < operations; ++k) {
+    int a = static_cast<int>(rng() % 160);
+    int b = static_cast<int>(rng() % 160);
+    switch (rng() % 5) {
+      case 0:
+        if (!g.exists(a))
+          g.add_Node(a);
+        break;
+      case 1:
+        if (g.exists(a))
+          g.remove_Node(a);
+        break;
+      default:
+        if (g.exists(a) && g.exists(b)) {
+          if (rng() % 3)
+            g.add_Arc(g.find(a), g.find(b));
+          else
+            g.remove_Arc(g.find(a), g.find(b));
+        }
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  replay.apply_delta(g.journal());
+  check(take(replay).nodes == take(g).nodes && take(replay).arcs == take(g).arcs,
+        label, operations);
+  std::cout << label << ": " << operations << " operazioni in "
+            << std::chrono::duration<double, std::milli>(stop - start).count()
+            << " ms, " << g.getSize() << " nodi finali" << std::endl;
+}
+
+int main() {
+  std::vector<int> ints;
+  std::vector<fragile> fragiles;
+  for (int i = 0; i < 12; ++i) {
+    ints.push_back(i * 3);
+    fragiles.push_back(fragile(i * 3));
+  }
+  sweep_all<Amgraph<int> >("Amgraph<int>", ints);
+  sweep_all<Amgraph<int, false> >("Amgraph<int, false>", ints);
+  sweep_all<Amgraph<fragile> >("Amgraph<fragile>", fragiles);
+
+  stress<Amgraph<int> >("stress Amgraph<int>", 20000);
+  stress<Amgraph<int, false> >("stress Amgraph<int, false>", 20000);
+
+  if (failures != 0) {
+    std::cout << failures << " violazioni della garanzia forte" << std::endl;
+    return 1;
+  }
+  std::cout << "Nessuna violazione" << std::endl;
+  return 0;
+}
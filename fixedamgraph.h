@@ -0,0 +1,270 @@
+#ifndef FIXEDAMGRAPH_H
+#define FIXEDAMGRAPH_H
+
+#include <cstdint>
+#include <stdexcept>
+
+/**
+  @file fixedamgraph.h
+  @brief Dichiarazione della classe FixedAmgraph
+*/
+
+/**
+  @brief Classe FixedAmgraph
+
+  Grafo orientato con al massimo N nodi noto a tempo di compilazione.
+  Nodi e matrice di adiacenza (una riga di bit per nodo) stanno dentro
+  l'oggetto: nessuna allocazione dinamica.
+
+  Tutti i metodi sono constexpr, per cui con un T letterale (interi,
+  enum, puntatori a stringhe costanti...) una tabella si può costruire
+  e interrogare a tempo di compilazione:
+
+    constexpr auto table = make_table();  // FixedAmgraph<State, 8>
+    static_assert(table.reachable(Idle, Done), "");
+
+  I nodi si cercano per confronto lineare e non ci sono handle:
+  add_Node restituisce l'indice del nodo (quello esistente se era già
+  presente), valido fino al prossimo remove_Node, che scala di uno gli
+  indici successivi. Oltre N nodi add_Node lancia std::length_error;
+  add_Arc, remove_Arc, connected e reachable lanciano
+  std::invalid_argument per nodi assenti. connected guarda entrambe le
+  direzioni dell'arco, reachable segue gli archi nel loro verso.
+
+  @see Amgraph
+*/
+template <typename T, unsigned int N>
+class FixedAmgraph {
+
+public:
+
+  typedef T value_type;
+  typedef unsigned int size_type;
+
+  /**
+    @brief Costruttore di default: grafo vuoto
+
+    @post getSize() == 0
+  */
+  constexpr FixedAmgraph() : _vertices(), _size(0), _rows() { }
+
+  /**
+    @brief Capacità massima
+  */
+  static constexpr size_type capacity() {
+    return N;
+  }
+
+  constexpr size_type getSize() const {
+    return _size;
+  }
+
+  /**
+    @brief Getter del nodo [index]
+
+    @pre index < getSize()
+  */
+  constexpr const value_type &operator[](size_type index) const {
+    return _vertices[index];
+  }
+
+  typedef const T *const_iterator;
+
+  constexpr const_iterator begin() const {
+    return _vertices;
+  }
+
+  constexpr const_iterator end() const {
+    return _vertices + _size;
+  }
+
+  /**
+    @brief Aggiunge un nodo isolato
+
+    Se il nodo è già presente non fa nulla.
+
+    @param node nodo da aggiungere
+
+    @return indice del nodo
+
+    @throw std::length_error se il grafo è pieno
+  */
+  constexpr size_type add_Node(const value_type &node) {
+    int present = getVertexIndex(node);
+    if (present != -1)
+      return static_cast<size_type>(present);
+    if (_size == N)
+      throw std::length_error("FixedAmgraph: capacità esaurita");
+    _vertices[_size] = node;
+    return _size++;
+  }
+
+  /**
+    @brief Rimuove un nodo e i suoi archi
+
+    Se il nodo non è presente non fa nulla.
+  */
+  constexpr void remove_Node(const value_type &node) {
+    int index = getVertexIndex(node);
+    if (index == -1)
+      return;
+    size_type k = static_cast<size_type>(index);
+    for (size_type i = k; i + 1 < _size; ++i) {
+      _vertices[i] = _vertices[i + 1];
+      for (size_type w = 0; w < words; ++w)
+        _rows[i][w] = _rows[i + 1][w];
+    }
+    --_size;
+    for (size_type w = 0; w < words; ++w)
+      _rows[_size][w] = 0;
+    for (size_type i = 0; i < _size; ++i)
+      eraseBit(_rows[i], k);
+  }
+
+  /**
+    @brief Aggiunge l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  constexpr void add_Arc(const value_type &node1, const value_type &node2) {
+    size_type src = indexOf(node1);
+    size_type dest = indexOf(node2);
+    _rows[src][dest / 64] |= std::uint64_t(1) << (dest % 64);
+  }
+
+  /**
+    @brief Rimuove l'arco node1 -> node2
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  constexpr void remove_Arc(const value_type &node1, const value_type &node2) {
+    size_type src = indexOf(node1);
+    size_type dest = indexOf(node2);
+    _rows[src][dest / 64] &= ~(std::uint64_t(1) << (dest % 64));
+  }
+
+  constexpr bool exists(const value_type &node) const {
+    return getVertexIndex(node) != -1;
+  }
+
+  /**
+    @brief true se c'è un arco tra i due nodi, in una qualsiasi direzione
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  constexpr bool connected(const value_type &node1, const value_type &node2) const {
+    size_type a = indexOf(node1);
+    size_type b = indexOf(node2);
+    return hasEdge(a, b) || hasEdge(b, a);
+  }
+
+  /**
+    @brief true se esiste un cammino orientato da node1 a node2
+
+    Un nodo raggiunge sempre se stesso.
+
+    @throw std::invalid_argument se uno dei nodi non esiste
+  */
+  constexpr bool reachable(const value_type &node1, const value_type &node2) const {
+    size_type target = indexOf(node2);
+    std::uint64_t seen[words] = {};
+    std::uint64_t frontier[words] = {};
+    size_type start = indexOf(node1);
+    seen[start / 64] |= std::uint64_t(1) << (start % 64);
+    frontier[start / 64] |= std::uint64_t(1) << (start % 64);
+
+    bool grown = true;
+    while (grown) {
+      if ((seen[target / 64] >> (target % 64)) & 1u)
+        return true;
+      std::uint64_t next[words] = {};
+      for (size_type i = 0; i < _size; ++i)
+        if ((frontier[i / 64] >> (i % 64)) & 1u)
+          for (size_type w = 0; w < words; ++w)
+            next[w] |= _rows[i][w];
+      grown = false;
+      for (size_type w = 0; w < words; ++w) {
+        frontier[w] = next[w] & ~seen[w];
+        seen[w] |= frontier[w];
+        if (frontier[w])
+          grown = true;
+      }
+    }
+    return (seen[target / 64] >> (target % 64)) & 1u;
+  }
+
+  /**
+    @brief Chiusura transitiva (Warshall sulle righe di bit)
+
+    @return un grafo con gli stessi nodi e un arco a -> b per ogni
+      cammino non vuoto da a a b
+  */
+  constexpr FixedAmgraph transitive_closure() const {
+    FixedAmgraph out(*this);
+    for (size_type k = 0; k < _size; ++k)
+      for (size_type i = 0; i < _size; ++i)
+        if (out.hasEdge(i, k))
+          for (size_type w = 0; w < words; ++w)
+            out._rows[i][w] |= out._rows[k][w];
+    return out;
+  }
+
+  /**
+    @brief Numero di archi uscenti dal nodo
+  */
+  constexpr size_type out_degree(const value_type &node) const {
+    size_type index = indexOf(node);
+    size_type count = 0;
+    for (size_type w = 0; w < words; ++w)
+      count += static_cast<size_type>(__builtin_popcountll(_rows[index][w]));
+    return count;
+  }
+
+private:
+
+  static constexpr size_type words = (N + 63) / 64 ? (N + 63) / 64 : 1;
+
+  constexpr bool hasEdge(size_type src, size_type dest) const {
+    return (_rows[src][dest / 64] >> (dest % 64)) & 1u;
+  }
+
+  /**
+   @brief getVertexIndex: Cerca Nodo
+
+    @returns -1 se non trovato
+    */
+  constexpr int getVertexIndex(const value_type &node) const {
+    for (size_type i = 0; i < _size; ++i)
+      if (node == _vertices[i])
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  constexpr size_type indexOf(const value_type &node) const {
+    int index = getVertexIndex(node);
+    if (index == -1)
+      throw std::invalid_argument("FixedAmgraph: Nodi non esistenti, c'è un errore di logica");
+    return static_cast<size_type>(index);
+  }
+
+  /**
+   @brief Toglie il bit k da una riga facendo scorrere i successivi
+
+    */
+  static constexpr void eraseBit(std::uint64_t *row, size_type k) {
+    size_type w = k / 64;
+    std::uint64_t low = row[w] & ((std::uint64_t(1) << (k % 64)) - 1);
+    std::uint64_t high = (k % 64 == 63) ? 0 : (row[w] >> (k % 64 + 1)) << (k % 64);
+    row[w] = low | high;
+    for (++w; w < words; ++w) {
+      row[w - 1] |= (row[w] & 1u) << 63;
+      row[w] >>= 1;
+    }
+  }
+
+  value_type _vertices[N ? N : 1]; ///< Nodi, i primi _size sono validi
+  size_type _size; ///< Numero di nodi
+  std::uint64_t _rows[N ? N : 1][words]; ///< Riga di bit per nodo
+};
+
+#endif
@@ -5,6 +5,12 @@
 #include <iostream>
 #include <fstream>
 #include "amgraph.h" 
+#include "fixedamgraph.h"
+#include "amgraph_builder.h"
+#include "diskamgraph.h"
+#include "compressedamgraph.h"
+#include "amgraph_batcher.h"
+#include <thread>
 #include <cassert>   
 #include <functional> // just for fun (tionals)
 #include <vector>
@@ -156,6 +162,935 @@ int test_3() {
   return 0;
 }
 
+int test_undirected() {
+  Amgraph<int, false> graph;
+  assert(!graph.is_directed());
+
+  for (int i = 1; i <= 5; ++i)
+    graph.add_Node(i);
+  graph.add_Arc(1, 2);
+  graph.add_Arc(4, 2);
+  graph.add_Arc(3, 3);
+  graph.add_Arc(5, 1);
+
+  // simmetria: un solo bit per arco
+  assert(graph.connected(2, 1));
+  assert(graph.connected(2, 4));
+  assert(graph.connected(3, 3));
+  assert(!graph.connected(1, 3));
+
+  graph.remove_Arc(2, 1);
+  assert(!graph.connected(1, 2));
+
+  graph.remove_Node(2);
+  assert(graph.getSize() == 4);
+  assert(!graph.exists(2));
+  assert(graph.connected(3, 3));
+  assert(graph.connected(1, 5));
+  assert(!graph.connected(1, 4));
+
+  Amgraph<int, false> copy(graph);
+  graph.remove_Arc(5, 1);
+  assert(copy.connected(5, 1));
+  assert(!graph.connected(5, 1));
+
+  std::cout << "graph for test_undirected:" << std::endl;
+  copy.print();
+  return 0;
+}
+
+int test_handles() {
+  Amgraph<Persona> graph;
+  typedef Amgraph<Persona>::vertex_handle handle;
+
+  handle a = graph.add_Node(Persona{"Adalberto", 19});
+  handle b = graph.add_Node(Persona{"Susanna", 24});
+  handle c = graph.add_Node(Persona{"Charlie", 21});
+
+  // un nodo già presente restituisce l'handle esistente
+  assert(graph.add_Node(Persona{"Susanna", 24}) == b);
+  assert(graph.find(Persona{"Charlie", 21}) == c);
+  assert(!graph.find(Persona{"Dave", 40}).valid());
+  assert(graph.value(a).nome == "Adalberto");
+
+  graph.add_Arc(a, b);
+  graph.add_Arc(a, c);
+  graph.add_Arc(c, b);
+  assert(graph.connected(b, a));
+  assert(graph.connected(Persona{"Charlie", 21}, Persona{"Susanna", 24}));
+
+  int count = 0;
+  for (handle h : graph.neighbors(a)) {
+    assert(h == b || h == c);
+    ++count;
+  }
+  assert(count == 2);
+
+  graph.remove_Arc(a, b);
+  assert(!graph.connected(a, b));
+
+  // non orientato: i vicini sono simmetrici
+  Amgraph<int, false> ugraph;
+  Amgraph<int, false>::vertex_handle u1 = ugraph.add_Node(1);
+  Amgraph<int, false>::vertex_handle u2 = ugraph.add_Node(2);
+  ugraph.add_Arc(u2, u1);
+  assert(*ugraph.neighbors(u1).begin() == u2);
+
+  // remove_Node sposta gli indici: gli handle vecchi vengono rifiutati
+  Amgraph<Persona> copy(graph);
+  assert(copy.contains(b) && copy.connected(c, b));
+  graph.remove_Node(Persona{"Adalberto", 19});
+  assert(!graph.contains(b));
+  try {
+    graph.connected(c, b);
+    assert(false);
+  }
+  catch (std::invalid_argument) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+  handle b2 = graph.find(Persona{"Susanna", 24});
+  assert(graph.contains(b2) && b2 != b);
+  assert(graph.value(b2).nome == "Susanna");
+  assert(!copy.contains(b2) && copy.contains(b));
+  assert(!graph.contains(handle()));
+  return 0;
+}
+
+int test_delta() {
+  Amgraph<std::string> source;
+  Amgraph<std::string> replica;
+
+  source.add_Node("A");
+  source.add_Node("B");
+  replica = source;
+
+  source.enable_journal();
+  source.add_Node("C");
+  source.add_Node("D");
+  source.add_Arc("A", "C");
+  source.add_Arc("D", "B");
+  source.add_Arc("C", "D");
+  source.remove_Node("B");
+  source.add_Node("E");
+  source.add_Arc("E", "A");
+  source.remove_Arc("A", "C");
+  source.add_Arc("A", "C");
+
+  Amgraph<std::string>::delta d = source.take_journal();
+  assert(source.journal().empty());
+
+  // ricostruzione dai dati trasmessi
+  Amgraph<std::string>::delta received(d.records(), d.nodes());
+  replica.apply_delta(received);
+
+  assert(replica.getSize() == source.getSize());
+  for (Amgraph<std::string>::size_type i = 0; i < source.getSize(); ++i) {
+    assert(replica[i] == source[i]);
+    for (Amgraph<std::string>::size_type j = 0; j < source.getSize(); ++j)
+      assert(replica.connected(source[i], source[j]) ==
+             source.connected(source[i], source[j]));
+  }
+  assert(!replica.exists("B"));
+  assert(replica.connected("A", "C"));
+
+  // lo stesso delta su una replica che non è più nello stato di partenza
+  try {
+    replica.apply_delta(received);
+    assert(false);
+  }
+  catch (std::invalid_argument) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+  assert(replica.getSize() == source.getSize() && !replica.exists("B"));
+
+  // intestazione valida per replica: il journal di una copia senza
+  // l'ultimo record (add_node, un byte)
+  Amgraph<std::string> probe(replica);
+  probe.enable_journal();
+  probe.add_Node("Q");
+  std::vector<unsigned char> header(probe.journal().records());
+  header.pop_back();
+
+  // un delta malformato non modifica il grafo
+  std::vector<unsigned char> bad(header);
+  bad.push_back(Amgraph<std::string>::delta::remove_node);
+  try {
+    replica.apply_delta(Amgraph<std::string>::delta(bad, std::vector<std::string>()));
+    assert(false);
+  }
+  catch (std::invalid_argument) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+  assert(replica.getSize() == source.getSize());
+
+  // nodo già presente, aggiunto due volte o non usato da nessun record
+  std::vector<unsigned char> add(header);
+  add.push_back(Amgraph<std::string>::delta::add_node);
+  std::vector<unsigned char> add_twice(add);
+  add_twice.push_back(Amgraph<std::string>::delta::add_node);
+  const Amgraph<std::string>::delta wrong[] = {
+    Amgraph<std::string>::delta(add, std::vector<std::string>(1, "A")),
+    Amgraph<std::string>::delta(add_twice, std::vector<std::string>(2, "Z")),
+    Amgraph<std::string>::delta(add, std::vector<std::string>(2, "Z"))
+  };
+  for (const Amgraph<std::string>::delta &w : wrong) {
+    try {
+      replica.apply_delta(w);
+      assert(false);
+    }
+    catch (std::invalid_argument) {
+      std::cout << "Exception correctly caugth" << std::endl;
+    }
+    assert(replica.getSize() == source.getSize());
+  }
+  // la stessa intestazione con un nodo nuovo è accettata
+  replica.apply_delta(Amgraph<std::string>::delta(add, std::vector<std::string>(1, "Z")));
+  assert(replica.exists("Z"));
+  replica.remove_Node("Z");
+
+  // un nodo rimosso nel delta può essere aggiunto di nuovo
+  Amgraph<std::string> again(replica);
+  again.enable_journal();
+  again.remove_Node("A");
+  again.add_Node("A");
+  replica.apply_delta(again.journal());
+  assert(replica.getSize() == source.getSize());
+  assert(replica.exists("A") && !replica.connected("A", "C"));
+  return 0;
+}
+
+int test_reorder() {
+  // cammino 0-1-2-...-9 inserito in ordine sparso
+  int order[] = {7, 2, 9, 0, 5, 3, 8, 1, 6, 4};
+  Amgraph<int, false> graph;
+  for (int i = 0; i < 10; ++i)
+    graph.add_Node(order[i]);
+  for (int i = 0; i < 9; ++i)
+    graph.add_Arc(i, i + 1);
+
+  Amgraph<int, false> replica(graph);
+  graph.enable_journal();
+
+  std::vector<Amgraph<int, false>::size_type> perm =
+    graph.reorder(Amgraph<int, false>::reverse_cuthill_mckee);
+  assert(perm.size() == 10);
+
+  // banda 1: ogni arco collega indici consecutivi
+  for (Amgraph<int, false>::size_type i = 0; i < 10; ++i) {
+    assert(graph[i] == replica[perm[i]]);
+    for (Amgraph<int, false>::size_type j = i + 2; j < 10; ++j)
+      assert(!graph.connected(graph.handle(i), graph.handle(j)));
+  }
+  for (int i = 0; i < 9; ++i)
+    assert(graph.connected(i, i + 1));
+
+  replica.apply_delta(graph.take_journal());
+  for (Amgraph<int, false>::size_type i = 0; i < 10; ++i)
+    assert(graph[i] == replica[i]);
+
+  // stella orientata: il centro va in testa
+  Amgraph<int> star;
+  for (int i = 0; i < 6; ++i)
+    star.add_Node(i);
+  for (int i = 0; i < 5; ++i)
+    star.add_Arc(i, 5);
+  star.reorder(Amgraph<int>::degree_sort);
+  assert(star[0] == 5);
+  assert(star.connected(0, 5));
+
+  star.reorder(Amgraph<int>::bfs_order);
+  assert(star.getSize() == 6);
+  return 0;
+}
+
+int test_subgraph() {
+  Amgraph<int> graph;
+  for (int i = 0; i < 8; ++i)
+    graph.add_Node(i);
+  for (int i = 0; i < 7; ++i)
+    graph.add_Arc(i, i + 1);
+  graph.add_Arc(6, 2);
+
+  int nodes[] = {6, 2, 3, 2};
+  Amgraph<int> sub = graph.induced_subgraph(nodes, nodes + 4);
+  assert(sub.getSize() == 3);
+  // ordine relativo del grafo originale
+  assert(sub[0] == 2 && sub[1] == 3 && sub[2] == 6);
+  assert(sub.connected(2, 3));
+  assert(sub.connected(6, 2));
+  assert(!sub.connected(3, 6));
+
+  try {
+    int missing[] = {1, 42};
+    graph.induced_subgraph(missing, missing + 2);
+    assert(false);
+  }
+  catch (std::invalid_argument) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+
+  // vista: BFS limitata ai nodi 0..4 senza copiare il grafo
+  int window[] = {0, 1, 2, 3, 4};
+  Amgraph<int>::subgraph_view view = graph.make_view(window, window + 5);
+  assert(view.count() == 5);
+  assert(!view.contains(graph.find(5)));
+
+  std::vector<int> seen;
+  breadth_first(view, graph.find(0),
+    [&](Amgraph<int>::vertex_handle h) { seen.push_back(graph.value(h)); });
+  assert(seen.size() == 5);
+  assert(seen.back() == 4);
+
+  view.exclude(graph.find(2));
+  seen.clear();
+  breadth_first(view, graph.find(0),
+    [&](Amgraph<int>::vertex_handle h) { seen.push_back(graph.value(h)); });
+  assert(seen.size() == 2);
+
+  // sull'intero grafo si arriva fino a 7
+  seen.clear();
+  breadth_first(graph, graph.find(0),
+    [&](Amgraph<int>::vertex_handle h) { seen.push_back(graph.value(h)); });
+  assert(seen.size() == 8);
+
+  Amgraph<int> compact = graph.induced_subgraph(view);
+  assert(compact.getSize() == 4);
+  assert(compact.connected(3, 4));
+  return 0;
+}
+
+int test_metrics() {
+  Amgraph<std::string> graph;
+  graph.add_Node("A");
+  graph.add_Node("B");
+  graph.add_Node("C");
+  graph.add_Arc("A", "C");
+  assert(graph.connected("C", "A"));
+
+  Amgraph_metrics m = graph.metrics();
+#ifdef AMGRAPH_METRICS
+  assert(m.add_node.calls == 3);
+  assert(m.add_arc.calls == 1);
+  assert(m.connected.calls == 1);
+  assert(m.reallocations == 3);
+  // 3 ricerche in add_Node, 2 in add_Arc e 2 in connected
+  assert(m.lookup.calls == 7);
+  assert(m.lookup.probes == 0 + 1 + 2 + 1 + 3 + 3 + 1);
+  assert(m.add_node.latency.count() == 3);
+  assert(m.add_node.latency.percentile(0.5) <= m.add_node.latency.max());
+  std::cout << m;
+  m.print_json(std::cout);
+  std::cout << std::endl;
+
+  graph.reset_metrics();
+  assert(graph.metrics().lookup.calls == 0);
+
+  // lettori concorrenti: nessun campione perso
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t)
+    readers.push_back(std::thread([&graph]() {
+      for (int k = 0; k < 1000; ++k)
+        graph.connected("A", "B");
+    }));
+  for (std::size_t t = 0; t < readers.size(); ++t)
+    readers[t].join();
+  m = graph.metrics();
+  assert(m.connected.calls == 4000);
+  assert(m.connected.latency.count() == 4000);
+  assert(m.lookup.calls == 8000);
+#else
+  assert(m.add_node.calls == 0);
+  assert(m.lookup.probes == 0);
+#endif
+  return 0;
+}
+
+// abbastanza nodi da allineare con la tabella hash, b in ordine inverso
+template <bool Directed>
+void check_algebra() {
+  Amgraph<std::string, Directed> a;
+  Amgraph<std::string, Directed> b;
+  for (int k = 0; k < 30; ++k)
+    a.add_Node("n" + std::to_string(k));
+  for (int k = 39; k >= 10; --k)
+    b.add_Node("n" + std::to_string(k));
+  for (int k = 0; k < 30; ++k)
+    for (int h = 0; h < 30; ++h)
+      if ((k * 7 + h * 3) % 5 == 0)
+        a.add_Arc("n" + std::to_string(k), "n" + std::to_string(h));
+  for (int k = 10; k < 40; ++k)
+    for (int h = 10; h < 40; ++h)
+      if ((k + h * 2) % 3 == 0)
+        b.add_Arc("n" + std::to_string(k), "n" + std::to_string(h));
+
+  Amgraph<std::string, Directed> u = graph_union(a, b);
+  Amgraph<std::string, Directed> i = graph_intersection(a, b);
+  Amgraph<std::string, Directed> d = graph_difference(a, b);
+  assert(u.getSize() == 40 && i.getSize() == 20 && d.getSize() == 30);
+  for (int k = 0; k < 40; ++k)
+    for (int h = 0; h < 40; ++h) {
+      std::string x = "n" + std::to_string(k), y = "n" + std::to_string(h);
+      bool in_a = a.exists(x) && a.exists(y) && a.connected(x, y);
+      bool in_b = b.exists(x) && b.exists(y) && b.connected(x, y);
+      assert(u.connected(x, y) == (in_a || in_b));
+      if (i.exists(x) && i.exists(y))
+        assert(i.connected(x, y) == (in_a && in_b));
+      if (d.exists(x) && d.exists(y))
+        assert(d.connected(x, y) == (in_a && !in_b));
+    }
+}
+
+int test_algebra() {
+  Amgraph<std::string> a;
+  Amgraph<std::string> b;
+  a.add_Node("A");
+  a.add_Node("B");
+  a.add_Node("C");
+  a.add_Arc("A", "B");
+  a.add_Arc("B", "C");
+
+  b.add_Node("D");
+  b.add_Node("C");
+  b.add_Node("B");
+  b.add_Arc("B", "C");
+  b.add_Arc("C", "D");
+
+  Amgraph<std::string> u = graph_union(a, b);
+  assert(u.getSize() == 4);
+  assert(u[0] == "A" && u[3] == "D");
+  assert(u.connected("A", "B"));
+  assert(u.connected("B", "C"));
+  assert(u.connected("C", "D"));
+
+  Amgraph<std::string> i = graph_intersection(a, b);
+  assert(i.getSize() == 2);
+  assert(i[0] == "B" && i[1] == "C");
+  assert(i.connected("B", "C"));
+
+  Amgraph<std::string> d = graph_difference(a, b);
+  assert(d.getSize() == 3);
+  assert(d.connected("A", "B"));
+  assert(!d.connected("B", "C"));
+
+  // transposta: solo l'orientamento cambia
+  Amgraph<std::string> t(a);
+  t.transpose();
+  assert(t.neighbors(t.find("A")).begin() == t.neighbors(t.find("A")).end());
+  assert(*t.neighbors(t.find("B")).begin() == t.find("A"));
+
+  a.add_Arc("C", "C");
+  a.complement();
+  assert(!a.connected("C", "C"));
+  assert(a.connected("A", "C"));
+  assert(*a.neighbors(a.find("A")).begin() == a.find("C"));
+
+  // non orientato, abbastanza grande da usare più parole per riga
+  Amgraph<int, false> ring;
+  for (int k = 0; k < 40; ++k)
+    ring.add_Node(k);
+  for (int k = 0; k < 40; ++k)
+    ring.add_Arc(k, (k + 1) % 40);
+  Amgraph<int, false> full = graph_union(ring, ring);
+  full.complement();
+  full = graph_union(full, ring);
+  for (int x = 0; x < 40; ++x)
+    for (int y = 0; y < 40; ++y)
+      assert(full.connected(x, y) == (x != y));
+  assert(graph_difference(full, full).connected(1, 2) == false);
+
+  check_algebra<true>();
+  check_algebra<false>();
+  return 0;
+}
+
+enum Stato { Idle, Running, Paused, Done, Error };
+
+constexpr FixedAmgraph<Stato, 5> make_automa() {
+  FixedAmgraph<Stato, 5> automa;
+  automa.add_Node(Idle);
+  automa.add_Node(Running);
+  automa.add_Node(Paused);
+  automa.add_Node(Done);
+  automa.add_Node(Error);
+  automa.add_Arc(Idle, Running);
+  automa.add_Arc(Running, Paused);
+  automa.add_Arc(Paused, Running);
+  automa.add_Arc(Running, Done);
+  automa.add_Arc(Error, Idle);
+  return automa;
+}
+
+// tabella costruita e interrogata a tempo di compilazione
+constexpr FixedAmgraph<Stato, 5> automa = make_automa();
+static_assert(automa.getSize() == 5, "");
+static_assert(automa.connected(Running, Idle), "");
+static_assert(automa.reachable(Idle, Done), "");
+static_assert(!automa.reachable(Done, Idle), "");
+static_assert(automa.transitive_closure().out_degree(Error) == 4, "");
+
+int test_fixed() {
+  FixedAmgraph<int, 70> graph;
+  for (int i = 0; i < 70; ++i)
+    graph.add_Node(i);
+  for (int i = 0; i < 69; ++i)
+    graph.add_Arc(i, i + 1);
+  assert(graph.reachable(0, 69));
+
+  // la rimozione sposta le colonne oltre il confine della parola
+  graph.remove_Node(10);
+  assert(graph.getSize() == 69);
+  assert(!graph.reachable(0, 69));
+  assert(graph.reachable(11, 69));
+  assert(graph.connected(64, 65));
+  assert(!graph.connected(9, 11));
+
+  try {
+    graph.add_Node(100);
+    graph.add_Node(101);
+    assert(false);
+  }
+  catch (std::length_error) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+
+  int count = 0;
+  for (int node : automa) {
+    assert(automa.exists(static_cast<Stato>(node)));
+    ++count;
+  }
+  assert(count == 5);
+  return 0;
+}
+
+int test_dense_ids() {
+  Amgraph<int> graph;
+  // crescita in coda e in testa della tabella diretta
+  for (int i = 10; i < 20; ++i)
+    graph.add_Node(i);
+  for (int i = 9; i >= -5; --i)
+    graph.add_Node(i);
+  assert(graph.getSize() == 25);
+  assert(graph.find(-5).index() == 24);
+  assert(graph.find(10).index() == 0);
+  assert(!graph.exists(20));
+  assert(!graph.exists(-6));
+
+  graph.add_Arc(-5, 19);
+  graph.remove_Node(0);
+  assert(!graph.exists(0));
+  assert(graph.find(-5).index() == 23);
+  assert(graph.connected(19, -5));
+
+  graph.reorder(Amgraph<int>::degree_sort);
+  assert(graph.connected(-5, 19));
+  assert(graph[graph.find(19).index()] == 19);
+
+  // identificativi sparsi: si torna alla ricerca lineare
+  graph.add_Node(1000000);
+  graph.add_Node(-1000000);
+  assert(graph.exists(1000000));
+  assert(graph.exists(-1000000));
+  assert(graph.exists(7));
+  assert(!graph.exists(1000001));
+
+  Amgraph<unsigned char> small;
+  small.add_Node(255);
+  small.add_Node(0);
+  assert(small.exists(255) && small.exists(0) && !small.exists(1));
+
+  // svuotato, il grafo torna all'indice diretto
+  while (graph.getSize() > 0)
+    graph.remove_Node(graph[0]);
+  assert(!graph.exists(7));
+  graph.add_Node(3);
+  graph.add_Node(4);
+  assert(graph.find(4).index() == 1 && !graph.exists(1000000));
+
+  // crescita in testa fino al minimo del tipo
+  Amgraph<signed char> low;
+  for (int i = -100; i >= -128; --i)
+    low.add_Node(static_cast<signed char>(i));
+  assert(low.getSize() == 29);
+  assert(low.find(-128).index() == 28);
+  assert(low.exists(-100) && !low.exists(-99));
+
+  Amgraph<int> descending;
+  for (int i = 0; i > -300; --i)
+    descending.add_Node(i);
+  assert(descending.find(-299).index() == 299);
+  return 0;
+}
+
+int test_builder() {
+  // quattro thread, nodi in parte sovrapposti, archi tra produttori
+  Amgraph_builder<int> builder;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    Amgraph_builder<int>::producer p = builder.make_producer();
+    threads.push_back(std::thread([p, t]() mutable {
+      for (int i = 0; i < 300; ++i)
+        p.add_Node(t * 200 + i);
+      for (int i = 0; i < 299; ++i)
+        p.add_Arc(t * 200 + i, t * 200 + i + 1);
+    }));
+  }
+  for (std::size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+
+  Amgraph<int> graph;
+  builder.finalize(graph);
+  assert(graph.getSize() == 900);
+  assert(graph[0] == 0 && graph[300] == 300);
+  for (int i = 0; i < 899; ++i)
+    assert(graph.connected(i, i + 1));
+  assert(!graph.connected(0, 2));
+
+  // un arco verso un nodo mai aggiunto: il grafo non cambia
+  Amgraph_builder<int>::producer p = builder.make_producer();
+  p.add_Arc(0, 5000);
+  try {
+    builder.finalize(graph);
+    assert(false);
+  }
+  catch (std::invalid_argument) {
+    std::cout << "Exception correctly caugth" << std::endl;
+  }
+  assert(graph.getSize() == 900);
+
+  // non orientato, matrice triangolare su più blocchi di byte
+  const int n = 1200;
+  Amgraph_builder<int, false> wide;
+  Amgraph_builder<int, false>::producer w = wide.make_producer();
+  Amgraph<int, false> expected;
+  for (int i = 0; i < n; ++i) {
+    w.add_Node(i);
+    expected.add_Node(i);
+  }
+  for (int i = 0; i < n; ++i) {
+    w.add_Arc(i, (i * 37 + 11) % n);
+    expected.add_Arc(expected.find(i), expected.find((i * 37 + 11) % n));
+  }
+  Amgraph<int, false> built;
+  wide.finalize(built);
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j)
+      assert(built.connected(i, j) == expected.connected(expected.find(i), expected.find(j)));
+
+  // tipo senza std::hash, non orientato
+  Amgraph_builder<Persona, false> people;
+  Amgraph_builder<Persona, false>::producer q = people.make_producer();
+  q.add_Node(Persona{"Adalberto", 19});
+  q.add_Node(Persona{"Susanna", 24});
+  q.add_Node(Persona{"Adalberto", 19});
+  q.add_Arc(Persona{"Susanna", 24}, Persona{"Adalberto", 19});
+  Amgraph<Persona, false> pgraph;
+  people.finalize(pgraph);
+  assert(pgraph.getSize() == 2);
+  assert(pgraph.connected(Persona{"Adalberto", 19}, Persona{"Susanna", 24}));
+  return 0;
+}
+
+int test_disk() {
+  // 700 nodi: 88 fasce di righe, ma la cache ne tiene solo 2
+  const int n = 700;
+  DiskAmgraph<int> disk("amgraph_disk_test.bin",
+                        2 * DiskAmgraph<int>::tile_bytes);
+  Amgraph<int> memory;
+  for (int i = 0; i < n; ++i) {
+    disk.add_Node(i);
+    memory.add_Node(i);
+  }
+  for (int i = 0; i < n; ++i) {
+    int j = (i * 37 + 11) % n;
+    int k = (i * 7 + 300) % n;
+    disk.add_Arc(i, j);
+    disk.add_Arc(k, i);
+    memory.add_Arc(memory.find(i), memory.find(j));
+    memory.add_Arc(memory.find(k), memory.find(i));
+  }
+  assert(disk.cache_misses() > 2);
+
+  // una riga sta in un solo tile
+  std::size_t misses = disk.cache_misses();
+  DiskAmgraph<int>::size_type visited = 0;
+  for (DiskAmgraph<int>::vertex_handle w : disk.neighbors(disk.find(350))) {
+    (void)w;
+    ++visited;
+  }
+  for (Amgraph<int>::vertex_handle w : memory.neighbors(memory.find(350))) {
+    (void)w;
+    --visited;
+  }
+  assert(visited == 0);
+  assert(disk.cache_misses() - misses <= 1);
+
+  DiskAmgraph<int>::vertex_handle stale = disk.find(699);
+  disk.remove_Node(5);
+  memory.remove_Node(5);
+  disk.remove_Node(699);
+  memory.remove_Node(699);
+  disk.add_Node(5000);
+  memory.add_Node(5000);
+  disk.add_Arc(5000, 3);
+  memory.add_Arc(5000, 3);
+
+  assert(disk.getSize() == memory.getSize());
+  for (int x = 0; x < n; x += 13)
+    for (int y = 0; y < n; y += 5)
+      if (memory.exists(x) && memory.exists(y))
+        assert(disk.connected(x, y) == memory.connected(x, y));
+  assert(disk.connected(3, 5000));
+  assert(!disk.exists(5));
+  assert(!disk.contains(stale));
+  try {
+    disk.neighbors(stale);
+    assert(false);
+  }
+  catch (const std::invalid_argument &) {
+  }
+
+  // gradi uscenti e visita sugli stessi nodi
+  std::vector<DiskAmgraph<int>::size_type> degrees = disk.degrees();
+  for (DiskAmgraph<int>::size_type i = 0; i < disk.getSize(); ++i) {
+    Amgraph<int>::vertex_handle h = memory.find(disk[i]);
+    DiskAmgraph<int>::size_type count = 0;
+    for (Amgraph<int>::vertex_handle w : memory.neighbors(h)) {
+      (void)w;
+      ++count;
+    }
+    assert(degrees[i] == count);
+  }
+
+  std::size_t reached_disk = 0;
+  std::size_t reached_memory = 0;
+  breadth_first(disk, disk.find(0),
+    [&](DiskAmgraph<int>::vertex_handle) { ++reached_disk; });
+  breadth_first(memory, memory.find(0),
+    [&](Amgraph<int>::vertex_handle) { ++reached_memory; });
+  assert(reached_disk == reached_memory);
+  return 0;
+}
+
+int test_compressed() {
+  // blocco bitmap: 20000 colonne pseudo-casuali in [0, 65536)
+  hybrid_row dense, sparse;
+  std::vector<bool> model(70000, false);
+  unsigned x = 12345;
+  for (int k = 0; k < 20000; ++k) {
+    x = x * 1103515245u + 12345u;
+    unsigned col = (x >> 8) % 65536;
+    dense.add(col);
+    model[col] = true;
+  }
+  for (unsigned col = 0; col < 70000; col += 97)
+    sparse.add(col);
+  std::size_t counts[3] = {0, 0, 0};
+  dense.chunk_types(counts);
+  assert(counts[1] == 1);
+
+  std::size_t expected = 0;
+  for (unsigned col = 0; col < 65536; col += 97)
+    if (model[col])
+      ++expected;
+  assert(dense.intersection_count(sparse) == expected);
+  assert(sparse.intersection_count(dense) == expected);
+  for (unsigned col = 0; col < 65536; col += 7)
+    assert(dense.contains(col) == model[col]);
+
+  // l'iteratore scorre i blocchi senza copiarli, come columns()
+  auto check_iteration = [](const hybrid_row &row) {
+    std::vector<std::uint32_t> all = row.columns();
+    std::size_t k = 0;
+    for (hybrid_row::const_iterator it = row.begin(); it != row.end(); ++it)
+      assert(*it == all[k++]);
+    assert(k == all.size());
+    assert(row.empty() || row.back() == all.back());
+  };
+  hybrid_row runs;
+  for (unsigned col = 65000; col < 67000; ++col)
+    runs.add(col);
+  runs.add(131072);
+  runs.optimize();
+  counts[0] = counts[1] = counts[2] = 0;
+  runs.chunk_types(counts);
+  assert(counts[2] == 2);
+  check_iteration(dense);
+  check_iteration(sparse);
+  check_iteration(runs);
+  check_iteration(hybrid_row());
+
+  // sotto i 4096 elementi il blocco torna array
+  for (unsigned col = 0; col < 65536; ++col)
+    if (model[col] && col % 8 != 0) {
+      dense.remove(col);
+      model[col] = false;
+    }
+  counts[0] = counts[1] = counts[2] = 0;
+  dense.chunk_types(counts);
+  assert(counts[0] == 1 && counts[1] == 0);
+  std::vector<std::uint32_t> cols = dense.columns();
+  assert(cols.size() == dense.cardinality());
+  for (std::size_t k = 0; k < cols.size(); ++k)
+    assert(model[cols[k]]);
+
+  // grafo con gradi sbilanciati: un hub verso tutti, uno verso un
+  // terzo dei nodi, gli altri con due archi
+  const int n = 3000;
+  CompressedAmgraph<int> graph;
+  for (int i = 0; i < n; ++i)
+    graph.add_Node(i);
+  for (int i = 0; i < n; ++i) {
+    graph.add_Arc(0, i);
+    if (i % 3 == 0)
+      graph.add_Arc(1, i);
+    graph.add_Arc(i, (i * 37 + 11) % n);
+    graph.add_Arc(i, (i + 1) % n);
+  }
+  graph.optimize();
+  graph.chunk_types(counts);
+  assert(counts[2] >= 1);
+  // la matrice di Amgraph occuperebbe n * n bool
+  assert(graph.memory_bytes() * 20 < std::size_t(n) * n);
+
+  CompressedAmgraph<int>::vertex_handle h0 = graph.find(0);
+  CompressedAmgraph<int>::vertex_handle h1 = graph.find(1);
+  assert(graph.out_degree(h0) == n);
+  assert(graph.common_successors(h0, h1) == graph.out_degree(h1));
+  assert(graph.connected(5, 0));
+  assert(graph.connected(2, 1));
+  assert(!graph.connected(4, 1));
+
+  std::size_t reached = 0;
+  breadth_first(graph, h0,
+    [&](CompressedAmgraph<int>::vertex_handle) { ++reached; });
+  assert(reached == std::size_t(n));
+
+  // remove_Node fa scalare gli indici come Amgraph
+  graph.remove_Node(2);
+  graph.remove_Arc(0, 10);
+  assert(graph.getSize() == n - 1);
+  assert(!graph.exists(2));
+  assert(graph.out_degree(graph.find(0)) == n - 2);
+  assert(graph.connected(3, 4));
+  assert(!graph.connected(0, 10));
+  assert(graph.connected(1, 3));
+  assert(!graph.connected(1, 4));
+  std::size_t successors = 0;
+  for (CompressedAmgraph<int>::vertex_handle w : graph.neighbors(graph.find(0))) {
+    assert(graph.value(w) != 10);
+    ++successors;
+  }
+  assert(successors == std::size_t(n - 2));
+  try {
+    graph.neighbors(h0);
+    assert(false);
+  }
+  catch (const std::invalid_argument &) {
+  }
+
+  // costruzione da un Amgraph
+  Amgraph<int> small;
+  for (int i = 0; i < 50; ++i)
+    small.add_Node(i);
+  for (int i = 0; i < 50; ++i)
+    small.add_Arc(i, (i * 7) % 50);
+  CompressedAmgraph<int> copy(small);
+  for (int i = 0; i < 50; ++i)
+    for (int j = 0; j < 50; ++j)
+      assert(copy.connected(i, j) == small.connected(i, j));
+  return 0;
+}
+
+template <typename T, bool Directed>
+void check_batch(const Amgraph<T, Directed> &graph, const std::vector<T> &keys) {
+  std::vector<std::pair<T, T> > queries;
+  for (std::size_t a = 0; a < keys.size(); a += 3)
+    for (std::size_t b = 0; b < keys.size(); b += 2)
+      if (graph.exists(keys[a]) && graph.exists(keys[b]))
+        queries.push_back(std::make_pair(keys[a], keys[b]));
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  graph.connected_batch(queries.data(), queries.size(), out.get());
+  for (std::size_t q = 0; q < queries.size(); ++q)
+    assert(out[q] == graph.connected(queries[q].first, queries[q].second));
+
+  std::unique_ptr<bool[]> present(new bool[keys.size()]);
+  graph.exists_batch(keys.data(), keys.size(), present.get());
+  for (std::size_t k = 0; k < keys.size(); ++k)
+    assert(present[k] == graph.exists(keys[k]));
+}
+
+int test_batch() {
+  const int n = 300;
+  Amgraph<int> ints;
+  Amgraph<int, false> undirected;
+  Amgraph<std::string> strings;
+  std::vector<int> int_keys;
+  std::vector<std::string> string_keys;
+  for (int i = 0; i < n; ++i) {
+    ints.add_Node(i);
+    undirected.add_Node(i);
+    strings.add_Node(std::to_string(i * 7));
+  }
+  for (int i = 0; i < n; ++i) {
+    int j = (i * 37 + 11) % n;
+    ints.add_Arc(i, j);
+    undirected.add_Arc(i, j);
+    strings.add_Arc(std::to_string(i * 7), std::to_string(j * 7));
+  }
+  // le chiavi oltre n non esistono
+  for (int i = 0; i < n + 20; ++i) {
+    int_keys.push_back(i);
+    string_keys.push_back(std::to_string(i * 7));
+  }
+  check_batch(ints, int_keys);
+  check_batch(undirected, int_keys);
+  check_batch(strings, string_keys);
+
+  // nodo mancante: eccezione prima di scrivere out
+  std::pair<int, int> bad[2] = {std::make_pair(0, 1), std::make_pair(0, 5000)};
+  bool out[2] = {true, true};
+  bool thrown = false;
+  try {
+    ints.connected_batch(bad, 2, out);
+  }
+  catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown && out[0] && out[1]);
+
+  // richieste concorrenti raccolte dal batcher
+  Amgraph_batcher<int> batcher(ints);
+  std::vector<std::thread> threads;
+  std::vector<int> errors(4, 0);
+  for (int t = 0; t < 4; ++t)
+    threads.push_back(std::thread([&, t]() {
+      std::vector<std::future<bool> > pending;
+      for (int k = 0; k < 500; ++k)
+        pending.push_back(batcher.connected((k * 13 + t) % n, (k * 29) % n));
+      std::future<bool> present = batcher.exists(n + t);
+      for (int k = 0; k < 500; ++k)
+        if (pending[k].get() != ints.connected((k * 13 + t) % n, (k * 29) % n))
+          ++errors[t];
+      if (present.get())
+        ++errors[t];
+    }));
+  for (std::size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+  for (int t = 0; t < 4; ++t)
+    assert(errors[t] == 0);
+
+  std::future<bool> missing = batcher.connected(0, -1);
+  thrown = false;
+  try {
+    missing.get();
+  }
+  catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
+
 void stress_test1 (int max_nodes){
     Amgraph<int> graph;
     for (int i = 1; i <= max_nodes; ++i) {
@@ -211,9 +1146,13 @@ struct Useless_data{
   bool operator ==(const Useless_data& d) const{
     return false;
   };
-  bool operator= (const Useless_data& other){
+  Useless_data(const Useless_data& other){
+    cose = new int[1];
+    cose[0] = *other.cose;
+  };
+  Useless_data& operator= (const Useless_data& other){
     cose[0] = *other.cose;
-    return this;
+    return *this;
   };
   ~Useless_data(){
     delete[] cose;
@@ -226,7 +1165,20 @@ int main(int argc, char *argv[]){
     {test_int, "test con graph<int"},
     {test_string, "test con graph<std::string>"},
     {test_persona, "test graph<Persona>"},
-    {test_3, "add nodes on graph<int> "}
+    {test_3, "add nodes on graph<int> "},
+    {test_undirected, "test graph<int, false> non orientato"},
+    {test_handles, "test handle dei vertici"},
+    {test_delta, "test journal e apply_delta"},
+    {test_reorder, "test riordino dei vertici"},
+    {test_subgraph, "test sottografi e viste"},
+    {test_metrics, "test metriche"},
+    {test_algebra, "test algebra dei grafi"},
+    {test_fixed, "test FixedAmgraph"},
+    {test_dense_ids, "test indice diretto per interi"},
+    {test_builder, "test costruzione parallela"},
+    {test_disk, "test DiskAmgraph su file"},
+    {test_compressed, "test CompressedAmgraph"},
+    {test_batch, "test interrogazioni in batch"}
   };
 
   for (const auto& testFunction : testFunctions) {